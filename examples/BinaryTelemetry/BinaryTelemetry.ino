@@ -0,0 +1,45 @@
+#include <CanSatKit.h>
+
+// list of fields sent in each frame
+#include "telemetry_schema.h"
+
+using namespace CanSatKit;
+
+Radio radio(Pins::Radio::ChipSelect,
+            Pins::Radio::DIO0,
+            433.0,
+            Bandwidth_125000_Hz,
+            SpreadingFactor_9,
+            CodingRate_4_8);
+
+BMP280 bmp;
+
+unsigned int counter = 1;
+
+void setup() {
+  SerialUSB.begin(115200);
+
+  radio.begin();
+  bmp.begin();
+  bmp.setOversampling(16);
+}
+
+void loop() {
+  double T, P;
+  bool ok = bmp.measureTemperatureAndPressure(T, P);
+
+  // fields are packed in binary form, 6 bytes instead of eg. "123;21.37;1013.25;1" as text
+  uint8_t frame[16];
+  TelemetryWriter telemetry(telemetry_schema, frame, sizeof(frame));
+  // the same order as in telemetry_schema
+  telemetry.write(counter);
+  telemetry.write(T);
+  telemetry.write(P);
+  telemetry.write(ok);
+
+  // send binary frame
+  radio.transmit(frame, telemetry.size());
+
+  counter++;
+  delay(1000);
+}
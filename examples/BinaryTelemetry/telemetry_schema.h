@@ -0,0 +1,16 @@
+// Fields of the telemetry frame, used also by the decoder on PC (extras/TelemetryDecoder).
+#ifndef TELEMETRY_SCHEMA_H_
+#define TELEMETRY_SCHEMA_H_
+
+#include <CanSatKitTelemetry.h>
+
+constexpr CanSatKit::TelemetryField telemetry_schema[] = {
+  CanSatKit::TelemetryField::unsigned_int("counter", 16),
+  // -40.00 ... 123.83 *C
+  CanSatKit::TelemetryField::fixed("temperature", -40.0, 0.01, 14),
+  // 300.00 ... 1610.71 hPa
+  CanSatKit::TelemetryField::fixed("pressure", 300.0, 0.01, 17),
+  CanSatKit::TelemetryField::flag("measurement_ok"),
+};
+
+#endif  // TELEMETRY_SCHEMA_H_
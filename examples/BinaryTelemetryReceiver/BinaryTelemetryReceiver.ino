@@ -0,0 +1,34 @@
+#include <CanSatKit.h>
+
+using namespace CanSatKit;
+
+// the same settings as in the BinaryTelemetry transmitter
+Radio radio(Pins::Radio::ChipSelect,
+            Pins::Radio::DIO0,
+            433.0,
+            Bandwidth_125000_Hz,
+            SpreadingFactor_9,
+            CodingRate_4_8);
+
+void setup() {
+  SerialUSB.begin(115200);
+
+  radio.begin();
+  radio.disable_debug();
+}
+
+void loop() {
+  uint8_t data[255];
+  uint8_t length;
+  radio.receive(data, length);
+
+  // print raw frame in hex, one frame per line
+  // save the output and decode it on PC with extras/TelemetryDecoder
+  for (uint8_t i = 0; i < length; ++i) {
+    if (data[i] < 0x10) {
+      SerialUSB.print('0');
+    }
+    SerialUSB.print(data[i], HEX);
+  }
+  SerialUSB.println();
+}
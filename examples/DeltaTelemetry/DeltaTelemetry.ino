@@ -0,0 +1,50 @@
+#include <CanSatKit.h>
+
+using namespace CanSatKit;
+
+Radio radio(Pins::Radio::ChipSelect,
+            Pins::Radio::DIO0,
+            433.0,
+            Bandwidth_125000_Hz,
+            SpreadingFactor_9,
+            CodingRate_4_8);
+
+BMP280 bmp;
+
+// temperature and pressure rounded to 0.01 *C and 0.01 hPa
+// consecutive samples differ a little, so most of them take 1 byte per value
+DeltaEncoder<2> encoder({0.01, 0.01});
+
+// send at least every 5 s, even if the frame is not full
+const uint8_t samples_per_frame = 50;
+
+void send_and_start_next_frame() {
+  radio.transmit(encoder.data(), encoder.size());
+  encoder.next_frame();
+}
+
+void setup() {
+  SerialUSB.begin(115200);
+
+  radio.begin();
+  bmp.begin();
+  // shorter measurement for 10 samples per second
+  bmp.setOversampling(4);
+}
+
+void loop() {
+  double T, P;
+  bmp.measureTemperatureAndPressure(T, P);
+
+  double sample[2] = {T, P};
+  if (!encoder.add(sample)) {
+    // frame full
+    send_and_start_next_frame();
+    encoder.add(sample);
+  }
+  if (encoder.samples() == samples_per_frame) {
+    send_and_start_next_frame();
+  }
+
+  delay(55);
+}
@@ -0,0 +1,39 @@
+#include <CanSatKit.h>
+
+using namespace CanSatKit;
+
+int counter = 1;
+
+Radio radio(Pins::Radio::ChipSelect,
+            Pins::Radio::DIO0,
+            433.0,
+            Bandwidth_125000_Hz,
+            SpreadingFactor_9,
+            CodingRate_4_8);
+
+void setup() {
+  SerialUSB.begin(115200);
+
+  radio.begin();
+}
+
+void loop() {
+  // TransmitFrame is filled directly in the radio transmit buffer,
+  // so the data is not copied when it is sent
+  TransmitFrame frame(radio);
+
+  if (frame.valid()) {
+    frame.print(counter);
+    frame.print(". Hello CanSat!");
+
+    // put frame into the transmit queue
+    frame.send();
+  } else {
+    // not enough space in the transmit buffer
+    SerialUSB.println("Transmit buffer full!");
+  }
+
+  counter++;
+
+  delay(1000);
+}
@@ -0,0 +1,78 @@
+// Decodes binary telemetry frames logged as hex lines (eg. by the BinaryTelemetryReceiver example)
+// into CSV with one column per schema field.
+//
+// Build (from repository root), pointing -I at the directory with telemetry_schema.h of your sketch:
+//   g++ -std=gnu++11 -O2 -Isrc -Iexamples/BinaryTelemetry extras/TelemetryDecoder/telemetry_decoder.cpp -o telemetry_decoder
+// Use:
+//   ./telemetry_decoder < received.log > telemetry.csv
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "telemetry_schema.h"
+
+using namespace CanSatKit;
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = std::toupper(static_cast<unsigned char>(c));
+  return c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+// false if the line is not a hex frame (eg. debug message)
+static bool parse_frame(const std::string& line, std::uint8_t* frame, std::uint8_t& length) {
+  std::string hex;
+  for (char c : line) {
+    if (!std::isspace(static_cast<unsigned char>(c))) {
+      hex += c;
+    }
+  }
+  if (hex.empty() || hex.size() % 2 != 0 || hex.size() > 2 * 255) {
+    return false;
+  }
+  length = hex.size() / 2;
+  for (std::size_t i = 0; i < length; ++i) {
+    int high = hex_digit(hex[2 * i]), low = hex_digit(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    frame[i] = high << 4 | low;
+  }
+  return true;
+}
+
+int main() {
+  constexpr std::size_t fields = sizeof(telemetry_schema) / sizeof(telemetry_schema[0]);
+  for (std::size_t i = 0; i < fields; ++i) {
+    std::printf("%s%s", i ? ";" : "", telemetry_schema[i].name);
+  }
+  std::printf("\n");
+
+  std::string line;
+  unsigned skipped = 0;
+  while (std::getline(std::cin, line)) {
+    std::uint8_t frame[255], length;
+    if (!parse_frame(line, frame, length)) {
+      skipped++;
+      continue;
+    }
+    TelemetryReader telemetry(telemetry_schema, frame, length);
+    double value;
+    for (std::size_t i = 0; telemetry.read(value); ++i) {
+      std::printf("%s%.10g", i ? ";" : "", value);
+    }
+    if (!telemetry.ok()) {
+      std::printf(";truncated frame");
+    }
+    std::printf("\n");
+  }
+  if (skipped) {
+    std::fprintf(stderr, "%u lines skipped\n", skipped);
+  }
+  return 0;
+}
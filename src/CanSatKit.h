@@ -3,6 +3,12 @@
 
 #include "CanSatKitRadio.h"
 #include "CanSatKitBMP280.h"
+#include "CanSatKitTelemetry.h"
+#include "CanSatKitDeltaCodec.h"
+#include "CanSatKitErasureCode.h"
+#include "CanSatKitReliableLink.h"
+#include "CanSatKitAdr.h"
+#include "CanSatKitTdma.h"
 
 namespace CanSatKit {
 namespace Pins {
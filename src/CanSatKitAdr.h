@@ -0,0 +1,388 @@
+#ifndef CANSATKITLIBRARY_ADR_H_
+#define CANSATKITLIBRARY_ADR_H_
+
+#include <cmath>
+#include <cstdint>
+
+#include "CanSatKitRadio.h"
+
+namespace CanSatKit {
+
+/**
+ * @brief Modem settings of one adaptive data rate step (frequency and coding rate are not changed).
+ */
+struct AdrProfile {
+  Radio::Bandwidth bandwidth;
+  Radio::SpreadingFactor spreadingFactor;
+};
+
+/**
+ * @brief Default profiles, from the most robust to the fastest (about 120 times faster than the first one).
+ */
+constexpr AdrProfile adr_default_profiles[] = {
+  {Bandwidth_125000_Hz, SpreadingFactor_12},
+  {Bandwidth_125000_Hz, SpreadingFactor_11},
+  {Bandwidth_125000_Hz, SpreadingFactor_10},
+  {Bandwidth_125000_Hz, SpreadingFactor_9},
+  {Bandwidth_125000_Hz, SpreadingFactor_8},
+  {Bandwidth_125000_Hz, SpreadingFactor_7},
+  {Bandwidth_250000_Hz, SpreadingFactor_7},
+  {Bandwidth_500000_Hz, SpreadingFactor_7},
+};
+constexpr std::uint8_t adr_default_profile_count = sizeof(adr_default_profiles) / sizeof(adr_default_profiles[0]);
+
+/**
+ * @brief Part shared by AdrController and AdrFollower: profiles, switching and control frames.
+ *
+ * Control frame: [0xAD][1 command, 2 acknowledgement][profile][sequence number]
+ * (padded with zeros in implicit header mode). Other frames must not look like it.
+ */
+template<class RadioType>
+class AdrLink {
+ public:
+  static constexpr std::uint8_t frame_length = 4;
+
+  AdrLink(const AdrLink&) = delete;
+  AdrLink& operator=(const AdrLink&) = delete;
+
+  /**
+   * @brief Switch the radio to the first (most robust) profile. Call it after radio begin().
+   *
+   * @return `false` if the radio could not be set up
+   */
+  bool begin() {
+    heard();
+    return apply(0);
+  }
+
+  /**
+   * @brief Index of the current profile.
+   */
+  std::uint8_t profile() const {
+    return current;
+  }
+
+  /**
+   * @brief Number of profile changes (including falls back after link loss).
+   */
+  std::uint32_t profile_changes() const {
+    return changes;
+  }
+
+ protected:
+  enum : std::uint8_t {
+    marker = 0xAD,
+    command = 1,
+    acknowledgement = 2,
+  };
+
+  AdrLink(RadioType& radio_, const AdrProfile* profiles_, std::uint8_t profile_count_, std::uint32_t link_timeout_ms_)
+    : radio(radio_), profiles(profiles_), profile_count(profile_count_), link_timeout_ms(link_timeout_ms_),
+      current(0), changes(0), last_heard(0) {}
+
+  bool apply(std::uint8_t index) {
+    Radio::Config config = radio.get_config();
+    config.bandwidth = profiles[index].bandwidth;
+    config.spreadingFactor = profiles[index].spreadingFactor;
+    if (!radio.set_config(config)) {
+      return false;
+    }
+    if (index != current) {
+      changes++;
+    }
+    current = index;
+    return true;
+  }
+
+  static bool parse(const std::uint8_t* frame, std::uint8_t length, std::uint8_t& type, std::uint8_t& index, std::uint8_t& sequence) {
+    if (length < frame_length || frame[0] != marker || (frame[1] != command && frame[1] != acknowledgement)) {
+      return false;
+    }
+    for (std::uint8_t i = frame_length; i < length; ++i) {
+      if (frame[i] != 0) {
+        return false;
+      }
+    }
+    type = frame[1];
+    index = frame[2];
+    sequence = frame[3];
+    return true;
+  }
+
+  void send(std::uint8_t type, std::uint8_t index, std::uint8_t sequence) {
+    const std::uint8_t frame[frame_length] = {marker, type, index, sequence};
+    radio.transmit(frame, frame_length);
+  }
+
+  void heard() {
+    last_heard = millis();
+  }
+
+  bool link_lost() const {
+    return millis() - last_heard > link_timeout_ms;
+  }
+
+  RadioType& radio;
+  const AdrProfile* profiles;
+  std::uint8_t profile_count;
+  std::uint32_t link_timeout_ms;
+  std::uint8_t current;
+  std::uint32_t changes;
+  std::uint32_t last_heard;
+};
+
+/**
+ * @brief Adaptive data rate, ground station side: measures the link margin of frames
+ * received from the can and commands it (AdrFollower) to use a faster or more robust profile.
+ *
+ *     AdrController<> adr(radio);
+ *
+ *     void setup() {
+ *       radio.begin();
+ *       adr.begin();
+ *     }
+ *
+ *     void loop() {
+ *       while (radio.available()) {
+ *         radio.receive(data, length, info);
+ *         if (!adr.handle(data, length, info.snr, info.rssi)) {
+ *           // telemetry frame
+ *         }
+ *       }
+ *       adr.poll();
+ *     }
+ *
+ * SNR of a frame is estimated from the measured SNR and, above the noise floor (where the
+ * measured SNR saturates), from RSSI. The margin is the SNR above the demodulation limit of the profile
+ * (Radio::demodulation_snr()) minus the installation margin kept for fading and antenna rotation.
+ * A faster profile is used when 4 frames in a row would keep the margin in it, one step at a time.
+ * When the margin of a frame drops below -3 dB, the controller goes down as many steps as needed at once.
+ *
+ * Commands are sent right after a frame from the can is received (the can listens then,
+ * if its transmit buffer is empty), so the can should leave gaps between its frames.
+ * The controller switches when the can acknowledges the command. Commands are also repeated
+ * as keepalive; if nothing is received for the link timeout, both sides go back to the first profile.
+ *
+ * The same profiles have to be used on both sides.
+ */
+template<class RadioType = Radio>
+class AdrController : public AdrLink<RadioType> {
+ public:
+  /**
+   * @brief Construct a new AdrController object
+   *
+   * @param radio_ radio used for the link
+   * @param margin_db_ installation margin in dB kept above the demodulation limit
+   * @param profiles_ profiles ordered from the most robust to the fastest
+   * @param profile_count_ number of profiles
+   * @param link_timeout_ms_ time without frames from the can after which the first profile is used
+   * (has to be longer than the time between frames of the can at the first profile)
+   * @param keepalive_ms_ time between commands sent to keep the can at the current profile
+   * (has to be shorter than the link timeout of the can)
+   */
+  explicit AdrController(RadioType& radio_, float margin_db_ = 10.0f,
+                         const AdrProfile* profiles_ = adr_default_profiles, std::uint8_t profile_count_ = adr_default_profile_count,
+                         std::uint32_t link_timeout_ms_ = 30000, std::uint32_t keepalive_ms_ = 10000)
+    : AdrLink<RadioType>(radio_, profiles_, profile_count_, link_timeout_ms_), margin_db(margin_db_), keepalive_ms(keepalive_ms_),
+      pending(false), pending_profile(0), sequence(0), attempts(0), last_command(0), measured(0), worst_snr(0), last_snr(0) {}
+
+  /**
+   * @brief Pass every frame received from the can with its SNR and RSSI (see Radio::FrameInfo).
+   *
+   * @return `true` if it was a control frame (used by the controller), `false` for other frames
+   */
+  bool handle(const std::uint8_t* frame, std::uint8_t length, float snr, int rssi) {
+    this->heard();
+    std::uint8_t type, index, answer;
+    if (this->parse(frame, length, type, index, answer)) {
+      if (type == this->acknowledgement && pending && answer == sequence && index == pending_profile) {
+        pending = false;
+        if (index != this->current && this->apply(index)) {
+          measured = 0;
+        }
+      }
+      return true;
+    }
+
+    measure(snr, rssi);
+    if (pending) {
+      if (attempts < max_attempts) {
+        attempts++;
+        this->send(this->command, pending_profile, sequence);
+        last_command = millis();
+      } else {
+        pending = false;
+      }
+    } else {
+      decide();
+      if (!pending && millis() - last_command >= keepalive_ms) {
+        send_command(this->current);
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Fall back to the first profile when the link is lost. Call it often (eg. in each loop() iteration).
+   */
+  void poll() {
+    if (this->link_lost()) {
+      pending = false;
+      measured = 0;
+      if (this->current != 0) {
+        this->apply(0);
+      }
+      this->heard();
+    }
+  }
+
+  /**
+   * @brief Margin of the last frame from the can in the current profile.
+   *
+   * @return float margin in dB above the demodulation limit and the installation margin
+   */
+  float margin() const {
+    return margin(last_snr, this->current);
+  }
+
+ private:
+  static constexpr std::uint8_t max_attempts = 3;
+  // frames that have to allow the next profile before it is used
+  static constexpr std::uint8_t frames_to_step_up = 4;
+  static constexpr float step_down_margin_db = -3.0f;
+
+  void measure(float snr, int rssi) {
+    // measured SNR saturates at about +10 dB, above that RSSI (signal and noise) over the noise floor
+    // (thermal noise in the bandwidth and 6 dB noise figure) tells more
+    float above_noise = rssi - (-174.0f + 10.0f * std::log10(static_cast<float>(Radio::bandwidth_in_hz(this->profiles[this->current].bandwidth))) + 6.0f);
+    last_snr = snr;
+    if (above_noise > 0) {
+      float rssi_snr = 10.0f * std::log10(std::pow(10.0f, above_noise / 10.0f) - 1.0f);
+      if (rssi_snr > snr) {
+        last_snr = rssi_snr;
+      }
+    }
+    if (measured == 0 || last_snr < worst_snr) {
+      worst_snr = last_snr;
+    }
+    measured++;
+  }
+
+  // margin a frame received with given SNR in the current profile would have in another profile
+  float margin(float snr, std::uint8_t index) const {
+    float bandwidth_ratio = static_cast<float>(Radio::bandwidth_in_hz(this->profiles[this->current].bandwidth))
+                            / Radio::bandwidth_in_hz(this->profiles[index].bandwidth);
+    return snr + 10.0f * std::log10(bandwidth_ratio) - Radio::demodulation_snr(this->profiles[index].spreadingFactor) - margin_db;
+  }
+
+  void decide() {
+    std::uint8_t next = this->current;
+    if (margin(last_snr, this->current) < step_down_margin_db) {
+      while (next > 0 && margin(last_snr, next) < 0) {
+        next--;
+      }
+    } else if (measured >= frames_to_step_up) {
+      if (this->current + 1 < this->profile_count && margin(worst_snr, this->current + 1) >= 0) {
+        next = this->current + 1;
+      }
+      // next frames decide again
+      measured = 0;
+    }
+    if (next != this->current) {
+      measured = 0;
+      send_command(next);
+    }
+  }
+
+  void send_command(std::uint8_t index) {
+    pending = true;
+    pending_profile = index;
+    sequence++;
+    attempts = 1;
+    this->send(this->command, index, sequence);
+    last_command = millis();
+  }
+
+  float margin_db;
+  std::uint32_t keepalive_ms;
+  bool pending;
+  std::uint8_t pending_profile;
+  std::uint8_t sequence;
+  std::uint8_t attempts;
+  std::uint32_t last_command;
+  std::uint8_t measured;
+  float worst_snr;
+  float last_snr;
+};
+
+/**
+ * @brief Adaptive data rate, can side: switches the radio to profiles commanded by AdrController.
+ *
+ *     AdrFollower<> adr(radio);
+ *
+ *     void loop() {
+ *       while (radio.available()) {
+ *         radio.receive(data, length);
+ *         if (!adr.handle(data, length)) {
+ *           // other frame from the ground station
+ *         }
+ *       }
+ *       adr.poll();
+ *       radio.transmit(telemetry, telemetry_length);
+ *     }
+ *
+ * A command is acknowledged in the current profile, then the radio is switched (after the transmit buffer is sent).
+ * If nothing is received from the ground station for the link timeout, the first profile is used.
+ */
+template<class RadioType = Radio>
+class AdrFollower : public AdrLink<RadioType> {
+ public:
+  /**
+   * @brief Construct a new AdrFollower object
+   *
+   * @param radio_ radio used for the link
+   * @param profiles_ profiles ordered from the most robust to the fastest (the same as in AdrController)
+   * @param profile_count_ number of profiles
+   * @param link_timeout_ms_ time without frames from the ground station after which the first profile is used
+   * (has to be longer than the keepalive time of AdrController)
+   */
+  explicit AdrFollower(RadioType& radio_, const AdrProfile* profiles_ = adr_default_profiles,
+                       std::uint8_t profile_count_ = adr_default_profile_count, std::uint32_t link_timeout_ms_ = 30000)
+    : AdrLink<RadioType>(radio_, profiles_, profile_count_, link_timeout_ms_) {}
+
+  /**
+   * @brief Pass every frame received from the ground station.
+   *
+   * @return `true` if it was a control frame (used by the follower), `false` for other frames
+   */
+  bool handle(const std::uint8_t* frame, std::uint8_t length) {
+    this->heard();
+    std::uint8_t type, index, sequence;
+    if (!this->parse(frame, length, type, index, sequence)) {
+      return false;
+    }
+    if (type == this->command && index < this->profile_count) {
+      this->send(this->acknowledgement, index, sequence);
+      if (index != this->current) {
+        this->apply(index);
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Fall back to the first profile when the link is lost. Call it often (eg. in each loop() iteration).
+   */
+  void poll() {
+    if (this->link_lost()) {
+      if (this->current != 0) {
+        this->apply(0);
+      }
+      this->heard();
+    }
+  }
+};
+
+};  // namespace CanSatKit
+
+#endif  // CANSATKITLIBRARY_ADR_H_
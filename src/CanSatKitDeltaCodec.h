@@ -0,0 +1,218 @@
+#ifndef CANSATKITLIBRARY_DELTACODEC_H_
+#define CANSATKITLIBRARY_DELTACODEC_H_
+
+#include <cstdint>
+
+#include "CanSatKitTelemetry.h"
+
+namespace CanSatKit {
+
+/**
+ * @brief Packs many samples of slowly changing measurements (eg. BMP280 temperature and pressure) into one frame.
+ * Each value is rounded to the channel resolution; the first sample of a frame (keyframe) is stored in full,
+ * next ones as differences to the previous sample (zigzag varints - 1 byte for a difference up to 63 steps).
+ * Frames don't depend on each other, so a lost frame loses only its own samples.
+ *
+ *     DeltaEncoder<2> encoder({0.01, 0.01});  // temperature *C, pressure hPa
+ *
+ *     double sample[2] = {T, P};
+ *     if (!encoder.add(sample)) {
+ *       radio.transmit(encoder.data(), encoder.size());
+ *       encoder.next_frame();
+ *       encoder.add(sample);
+ *     }
+ *
+ * Frame: [sequence number][keyframe: zigzag varint per channel][differences: zigzag varint per channel]...
+ */
+template<std::uint8_t channels>
+class DeltaEncoder {
+ public:
+  /**
+   * @brief Construct a new DeltaEncoder object
+   *
+   * @param resolution_ resolution of each channel (the smallest change that is sent)
+   * @param max_length_ maximum frame length in bytes (up to 255)
+   */
+  DeltaEncoder(const double (&resolution_)[channels], std::uint8_t max_length_ = 255) : max_length(max_length_), sequence(0) {
+    for (std::uint8_t i = 0; i < channels; ++i) {
+      resolution[i] = resolution_[i];
+    }
+    next_frame();
+  }
+
+  // writer points into own buffer
+  DeltaEncoder(const DeltaEncoder&) = delete;
+  DeltaEncoder& operator=(const DeltaEncoder&) = delete;
+
+  /**
+   * @brief Append sample to the frame.
+   *
+   * @return `true` if added, `false` if the frame is full (send it and start next_frame())
+   */
+  bool add(const double (&values)[channels]) {
+    std::int32_t quantized[channels];
+    std::uint16_t needed = 0;
+    for (std::uint8_t i = 0; i < channels; ++i) {
+      quantized[i] = quantize(values[i], resolution[i]);
+      // unsigned difference wraps around the same way in the decoder
+      needed += TelemetryWriter::varint_size(TelemetryWriter::zigzag(delta(quantized[i], i)));
+    }
+    if (writer.size() + needed > max_length) {
+      return false;
+    }
+    for (std::uint8_t i = 0; i < channels; ++i) {
+      writer.write_zigzag(delta(quantized[i], i));
+      previous[i] = quantized[i];
+    }
+    count++;
+    return true;
+  }
+
+  /**
+   * @brief Start a new frame (with a keyframe), increments sequence number.
+   */
+  void next_frame() {
+    writer = TelemetryWriter(buffer, max_length);
+    writer.write_bits(sequence++, 8);
+    count = 0;
+  }
+
+  /**
+   * @brief Encoded frame.
+   */
+  const std::uint8_t* data() const {
+    return buffer;
+  }
+
+  /**
+   * @brief Length of the encoded frame in bytes.
+   */
+  std::uint8_t size() const {
+    return writer.size();
+  }
+
+  /**
+   * @brief Number of samples in the frame.
+   */
+  std::uint8_t samples() const {
+    return count;
+  }
+
+  // round to nearest, saturated to 32 bits
+  static std::int32_t quantize(double value, double resolution) {
+    value /= resolution;
+    value = value >= -2147483648.0 ? (value <= 2147483647.0 ? value : 2147483647.0) : -2147483648.0;
+    return static_cast<std::int32_t>(value < 0 ? value - 0.5 : value + 0.5);
+  }
+
+ private:
+  std::int32_t delta(std::int32_t quantized, std::uint8_t channel) const {
+    return count == 0 ? quantized : static_cast<std::int32_t>(static_cast<std::uint32_t>(quantized) - static_cast<std::uint32_t>(previous[channel]));
+  }
+
+  double resolution[channels];
+  std::int32_t previous[channels];
+  std::uint8_t buffer[255];
+  std::uint8_t max_length;
+  std::uint8_t sequence;
+  std::uint8_t count;
+  TelemetryWriter writer = TelemetryWriter(buffer, 0);
+};
+
+/**
+ * @brief Decodes frames of DeltaEncoder with the same channel resolutions.
+ * Works the same on the receiving board and on PC:
+ *
+ *     DeltaDecoder<2> decoder({0.01, 0.01});
+ *     decoder.begin(data, length);
+ *     double sample[2];
+ *     while (decoder.next(sample)) {
+ *       // sample[0] - temperature, sample[1] - pressure
+ *     }
+ */
+template<std::uint8_t channels>
+class DeltaDecoder {
+ public:
+  /**
+   * @brief Construct a new DeltaDecoder object
+   *
+   * @param resolution_ resolution of each channel, the same as in DeltaEncoder
+   */
+  explicit DeltaDecoder(const double (&resolution_)[channels]) : reader(nullptr, 0), started(false), last_sequence(0), lost_frames(0) {
+    for (std::uint8_t i = 0; i < channels; ++i) {
+      resolution[i] = resolution_[i];
+    }
+  }
+
+  /**
+   * @brief Start decoding a received frame.
+   *
+   * @return `false` if the frame is empty
+   */
+  bool begin(const std::uint8_t* data, std::uint8_t length) {
+    reader = TelemetryReader(data, length);
+    count = 0;
+    std::uint32_t frame_sequence;
+    if (!reader.read_bits(frame_sequence, 8)) {
+      return false;
+    }
+    if (started) {
+      lost_frames += static_cast<std::uint8_t>(frame_sequence - last_sequence - 1);
+    }
+    started = true;
+    last_sequence = frame_sequence;
+    return true;
+  }
+
+  /**
+   * @brief Get next sample of the frame.
+   *
+   * @return `false` if there are no more (complete) samples
+   */
+  bool next(double (&values)[channels]) {
+    if (reader.at_end()) {
+      return false;
+    }
+    std::int32_t quantized[channels];
+    for (std::uint8_t i = 0; i < channels; ++i) {
+      std::int32_t delta;
+      if (!reader.read_zigzag(delta)) {
+        return false;
+      }
+      quantized[i] = count == 0 ? delta : static_cast<std::int32_t>(static_cast<std::uint32_t>(previous[i]) + static_cast<std::uint32_t>(delta));
+    }
+    for (std::uint8_t i = 0; i < channels; ++i) {
+      previous[i] = quantized[i];
+      values[i] = quantized[i] * resolution[i];
+    }
+    count++;
+    return true;
+  }
+
+  /**
+   * @brief Sequence number of the current frame (0 ... 255, wraps around).
+   */
+  std::uint8_t sequence() const {
+    return last_sequence;
+  }
+
+  /**
+   * @brief Number of frames missing between the decoded ones (up to 255 in a row are detected).
+   */
+  std::uint32_t lost() const {
+    return lost_frames;
+  }
+
+ private:
+  double resolution[channels];
+  std::int32_t previous[channels];
+  TelemetryReader reader;
+  bool started;
+  std::uint8_t last_sequence;
+  std::uint8_t count;
+  std::uint32_t lost_frames;
+};
+
+};  // namespace CanSatKit
+
+#endif  // CANSATKITLIBRARY_DELTACODEC_H_
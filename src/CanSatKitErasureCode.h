@@ -0,0 +1,365 @@
+#ifndef CANSATKITLIBRARY_ERASURECODE_H_
+#define CANSATKITLIBRARY_ERASURECODE_H_
+
+#include <cstdint>
+#include <cstring>
+
+namespace CanSatKit {
+
+/**
+ * @brief Arithmetic in GF(2^8) (polynomial 0x11D) used by ErasureEncoder and ErasureDecoder.
+ * Tables are constant, so they are kept in flash.
+ */
+class GF256 {
+ public:
+  static std::uint8_t multiply(std::uint8_t a, std::uint8_t b);
+  static std::uint8_t inverse(std::uint8_t a);
+
+  // dst[i] ^= c * src[i]
+  static void multiply_add(std::uint8_t* dst, const std::uint8_t* src, std::uint8_t c, std::uint16_t length);
+
+  // buffer[i] = c * buffer[i], c != 0
+  static void scale(std::uint8_t* buffer, std::uint8_t c, std::uint16_t length);
+
+  // Cauchy matrix: any square submatrix is invertible, so any data_frames of the
+  // data_frames + parity_frames frames of a block are enough to rebuild it
+  static std::uint8_t coefficient(std::uint8_t data_frames, std::uint8_t parity, std::uint8_t data) {
+    return inverse(data ^ static_cast<std::uint8_t>(data_frames + parity));
+  }
+};
+
+/**
+ * @brief Forward erasure coding across frames: after every `data_frames` frames,
+ * `parity_frames` extra frames are sent. The receiver (ErasureDecoder) rebuilds
+ * up to `parity_frames` lost frames of each block, without retransmission.
+ *
+ *     ErasureEncoder<8, 2> encoder;  // 25% more frames, any 2 of 10 can be lost
+ *
+ *     encoder.add(data, length);
+ *     const uint8_t* frame;
+ *     uint8_t frame_length;
+ *     while (encoder.next(frame, frame_length)) {
+ *       radio.transmit(frame, frame_length);
+ *     }
+ *
+ * Frame: [block number][index: 0 ... data_frames - 1 data, next ones parity][payload]
+ */
+template<std::uint8_t data_frames, std::uint8_t parity_frames>
+class ErasureEncoder {
+  static_assert(data_frames > 0 && parity_frames > 0, "block needs data and parity frames");
+  static_assert(data_frames + parity_frames <= 32, "up to 32 frames in a block");
+
+ public:
+  /**
+   * @brief Construct a new ErasureEncoder object
+   *
+   * @param max_frame_length_ maximum length of transmitted frames (up to 255)
+   */
+  explicit ErasureEncoder(std::uint8_t max_frame_length_ = 255) : max_frame_length(max_frame_length_), block(0), index(0), data_pending(false), parity_pending(0) {
+    start_block();
+  }
+
+  // frames point into own buffers
+  ErasureEncoder(const ErasureEncoder&) = delete;
+  ErasureEncoder& operator=(const ErasureEncoder&) = delete;
+
+  /**
+   * @brief Maximum length of data passed to add() - 3 bytes less than frame length.
+   */
+  std::uint8_t max_length() const {
+    return max_frame_length - 3;
+  }
+
+  /**
+   * @brief Encode next frame of data. Frames to transmit are then returned by next().
+   *
+   * @return `false` if length is 0 or above max_length() (nothing is encoded)
+   */
+  bool add(const std::uint8_t* data, std::uint8_t length) {
+    if (length == 0 || length > max_length()) {
+      return false;
+    }
+    if (index == data_frames) {
+      block++;
+      start_block();
+    }
+    data_frame[0] = block;
+    data_frame[1] = index;
+    std::memcpy(&data_frame[2], data, length);
+    data_length = length + 2;
+
+    // parity covers [length][data] padded with zeros to the longest frame of the block
+    for (std::uint8_t i = 0; i < parity_frames; ++i) {
+      std::uint8_t c = GF256::coefficient(data_frames, i, index);
+      parity[i][2] ^= GF256::multiply(c, length);
+      GF256::multiply_add(&parity[i][3], data, c, length);
+    }
+    if (length + 1u > parity_length) {
+      parity_length = length + 1u;
+    }
+
+    index++;
+    data_pending = true;
+    parity_pending = index == data_frames ? parity_frames : 0;
+    parity_sent = 0;
+    return true;
+  }
+
+  /**
+   * @brief Get next frame to transmit, valid until next call of add().
+   *
+   * @return `false` if there are no more frames
+   */
+  bool next(const std::uint8_t*& frame, std::uint8_t& length) {
+    if (data_pending) {
+      data_pending = false;
+      frame = data_frame;
+      length = data_length;
+      return true;
+    }
+    if (parity_sent < parity_pending) {
+      std::uint8_t* p = parity[parity_sent];
+      p[0] = block;
+      p[1] = data_frames + parity_sent;
+      parity_sent++;
+      frame = p;
+      length = parity_length + 2;
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  void start_block() {
+    index = 0;
+    parity_length = 0;
+    std::memset(parity, 0, sizeof(parity));
+  }
+
+  std::uint8_t data_frame[255];
+  std::uint8_t parity[parity_frames][255];
+  std::uint8_t max_frame_length;
+  std::uint8_t block;
+  std::uint8_t index;
+  std::uint8_t data_length;
+  std::uint8_t parity_length;
+  bool data_pending;
+  std::uint8_t parity_pending;
+  std::uint8_t parity_sent;
+};
+
+/**
+ * @brief Receiving side of ErasureEncoder (the same data_frames and parity_frames).
+ * Works the same on the receiving board and on PC:
+ *
+ *     ErasureDecoder<8, 2> decoder;
+ *
+ *     radio.receive(frame, length);
+ *     decoder.add(frame, length);
+ *     const uint8_t* data;
+ *     uint8_t data_length;
+ *     while (decoder.next(data, data_length)) {
+ *       // data as passed to ErasureEncoder::add()
+ *     }
+ *
+ * Data frames are returned as soon as they are received, rebuilt ones as soon as
+ * enough frames of the block are received (so they may come after the next ones).
+ */
+template<std::uint8_t data_frames, std::uint8_t parity_frames>
+class ErasureDecoder {
+  static_assert(data_frames > 0 && parity_frames > 0, "block needs data and parity frames");
+  static_assert(data_frames + parity_frames <= 32, "up to 32 frames in a block");
+
+ public:
+  ErasureDecoder() : started(false), block(0), count(0), received(0), ready(0), delivered(0), recovered_frames(0), lost_frames(0) {}
+
+  // data points into own buffers
+  ErasureDecoder(const ErasureDecoder&) = delete;
+  ErasureDecoder& operator=(const ErasureDecoder&) = delete;
+
+  /**
+   * @brief Pass received frame (frames not from ErasureEncoder are ignored).
+   * Call next() until it returns `false` before adding another frame.
+   */
+  void add(const std::uint8_t* frame, std::uint8_t length) {
+    ready = 0;
+    if (length < 3 || frame[1] >= data_frames + parity_frames) {
+      return;
+    }
+    if (!started || frame[0] != block) {
+      start_block(frame[0]);
+    }
+    std::uint8_t index = frame[1];
+    std::uint32_t bit = static_cast<std::uint32_t>(1) << index;
+    // block already complete or duplicate
+    if (count == data_frames || (received & bit)) {
+      return;
+    }
+    std::uint8_t payload_length = length - 2;
+    std::uint8_t* slot = slots[count];
+    if (index < data_frames) {
+      if (payload_length > codeword_length - 1) {
+        return;
+      }
+      slot[0] = payload_length;
+      std::memcpy(&slot[1], &frame[2], payload_length);
+      std::memset(&slot[1 + payload_length], 0, codeword_length - 1 - payload_length);
+      ready |= 1u << count;
+      delivered++;
+    } else {
+      if (payload_length > codeword_length) {
+        return;
+      }
+      std::memcpy(slot, &frame[2], payload_length);
+      std::memset(&slot[payload_length], 0, codeword_length - payload_length);
+      parity_length = payload_length;
+    }
+    slot_index[count] = index;
+    received |= bit;
+    count++;
+    if (count == data_frames) {
+      recover();
+    }
+  }
+
+  /**
+   * @brief Get next data frame, valid until next call of add().
+   *
+   * @return `false` if there are no more frames
+   */
+  bool next(const std::uint8_t*& data, std::uint8_t& length) {
+    while (ready) {
+      std::uint8_t i = 0;
+      while (!(ready & (1u << i))) {
+        i++;
+      }
+      ready &= ~(1u << i);
+      // rebuilt length can be wrong only if frames of the block did not match
+      if (slots[i][0] == 0 || slots[i][0] > codeword_length - 1) {
+        continue;
+      }
+      data = &slots[i][1];
+      length = slots[i][0];
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Number of data frames rebuilt from parity frames.
+   */
+  std::uint32_t recovered() const {
+    return recovered_frames;
+  }
+
+  /**
+   * @brief Number of data frames that could not be rebuilt (counted when the next block starts).
+   */
+  std::uint32_t lost() const {
+    return lost_frames;
+  }
+
+ private:
+  static constexpr std::uint8_t codeword_length = 253;
+
+  void start_block(std::uint8_t next_block) {
+    if (started) {
+      lost_frames += data_frames - delivered;
+      lost_frames += static_cast<std::uint32_t>(static_cast<std::uint8_t>(next_block - block - 1)) * data_frames;
+    }
+    started = true;
+    block = next_block;
+    count = 0;
+    received = 0;
+    delivered = 0;
+  }
+
+  // any data_frames frames of the block are received - rebuild missing data frames
+  // in place of parity frames (as many parity as missing data frames)
+  void recover() {
+    std::uint8_t parity_slots[parity_frames], missing[parity_frames];
+    std::uint8_t n = 0, m = 0;
+    for (std::uint8_t i = 0; i < data_frames; ++i) {
+      if (slot_index[i] >= data_frames) {
+        parity_slots[n++] = i;
+      }
+      if (!(received & (static_cast<std::uint32_t>(1) << i))) {
+        missing[m++] = i;
+      }
+    }
+    if (n == 0) {
+      return;
+    }
+
+    // remove known data from parity
+    std::uint8_t matrix[parity_frames][parity_frames];
+    for (std::uint8_t r = 0; r < n; ++r) {
+      std::uint8_t parity = slot_index[parity_slots[r]] - data_frames;
+      for (std::uint8_t i = 0; i < data_frames; ++i) {
+        std::uint8_t index = slot_index[i];
+        if (index < data_frames) {
+          GF256::multiply_add(slots[parity_slots[r]], slots[i], GF256::coefficient(data_frames, parity, index), parity_length);
+        }
+      }
+      for (std::uint8_t c = 0; c < n; ++c) {
+        matrix[r][c] = GF256::coefficient(data_frames, parity, missing[c]);
+      }
+    }
+
+    // Gauss-Jordan elimination, rows of the matrix go with parity frames
+    for (std::uint8_t c = 0; c < n; ++c) {
+      std::uint8_t pivot = c;
+      while (matrix[pivot][c] == 0) {
+        pivot++;
+      }
+      if (pivot != c) {
+        for (std::uint8_t k = 0; k < n; ++k) {
+          std::uint8_t tmp = matrix[c][k];
+          matrix[c][k] = matrix[pivot][k];
+          matrix[pivot][k] = tmp;
+        }
+        std::uint8_t tmp = parity_slots[c];
+        parity_slots[c] = parity_slots[pivot];
+        parity_slots[pivot] = tmp;
+      }
+      std::uint8_t scale = GF256::inverse(matrix[c][c]);
+      for (std::uint8_t k = 0; k < n; ++k) {
+        matrix[c][k] = GF256::multiply(matrix[c][k], scale);
+      }
+      GF256::scale(slots[parity_slots[c]], scale, parity_length);
+      for (std::uint8_t r = 0; r < n; ++r) {
+        std::uint8_t factor = matrix[r][c];
+        if (r == c || factor == 0) {
+          continue;
+        }
+        for (std::uint8_t k = 0; k < n; ++k) {
+          matrix[r][k] ^= GF256::multiply(factor, matrix[c][k]);
+        }
+        GF256::multiply_add(slots[parity_slots[r]], slots[parity_slots[c]], factor, parity_length);
+      }
+    }
+
+    for (std::uint8_t r = 0; r < n; ++r) {
+      slot_index[parity_slots[r]] = missing[r];
+      ready |= 1u << parity_slots[r];
+    }
+    delivered += n;
+    recovered_frames += n;
+  }
+
+  std::uint8_t slots[data_frames][codeword_length];
+  std::uint8_t slot_index[data_frames];
+  bool started;
+  std::uint8_t block;
+  std::uint8_t count;
+  std::uint8_t parity_length;
+  std::uint32_t received;
+  std::uint32_t ready;
+  std::uint8_t delivered;
+  std::uint32_t recovered_frames;
+  std::uint32_t lost_frames;
+};
+
+};  // namespace CanSatKit
+
+#endif  // CANSATKITLIBRARY_ERASURECODE_H_
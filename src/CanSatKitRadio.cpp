@@ -1,6 +1,4 @@
 #include <Arduino.h>
-#include <math.h>
-#include <SPI.h>
 #include <string.h>
 
 #include "CanSatKitRadio.h"
@@ -12,74 +10,84 @@ using std::uint32_t;
 using namespace CanSatKit;
 
 
-// FIFO for 10 frames
-FIFO<uint8_t, 2571> fifo_tx, fifo_rx;
-
-static int pin_cs, pin_dio0;
-static float frequency_in_mhz;
-static Radio::Bandwidth bandwidth;
-static Radio::SpreadingFactor spreadingFactor;
-static Radio::CodingRate codingRate;
-
-static bool debug_enabled = true;
-
-
-static constexpr uint8_t SPI_READ = 0b00000000;
-static constexpr uint8_t SPI_WRITE = 0b10000000;
+// Debug messages of the interrupt (and of the main loop with interrupt blocked) are queued
+// as DebugRecord, see print_debug_log().
+enum DebugEvent : uint8_t {
+  DEBUG_MODE_TX,
+  DEBUG_MODE_RX,
+  DEBUG_TX_QUEUE_CLEARED,
+  DEBUG_CRC_FAIL,
+  DEBUG_RX_BUFFER_FULL,
+  DEBUG_MALFORMED_AGGREGATE,
+  DEBUG_FORCE_INTERRUPT,
+  DEBUG_CHANNEL_BUSY,
+  DEBUG_WAIT_FOR_SLOT,
+};
 
-static uint8_t read_register(uint8_t reg) {
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-  digitalWrite(pin_cs, LOW);
-  SPI.transfer(reg | SPI_READ);
-  auto inByte = SPI.transfer(0x00);
-  SPI.endTransaction();
-  digitalWrite(pin_cs, HIGH);
-  return inByte;
-}
+static const char* const debug_messages[] = {
+  "change mode to TX",
+  "change mode to RX",
+  "cleared TX queue",
+  "CRC fail!",
+  "RX buffer full!",
+  "malformed aggregated frame!",
+  "force interrupt",
+  "channel busy, backing off",
+  "waiting for TDMA slot",
+};
 
-static uint8_t read_register(uint8_t reg, uint8_t msb, uint8_t lsb) {
-  uint8_t rawValue = read_register(reg);
-  uint8_t maskedValue = rawValue & ((0b11111111 << lsb) & (0b11111111 >> (7 - msb)));
-  return(maskedValue);
+// interrupt or main loop with interrupt blocked only (single producer)
+void RadioBase::log_debug(uint8_t event, uint8_t length) {
+  if (!debug_enabled) {
+    return;
+  }
+  DebugRecord record = {micros(), event, length};
+  if (!debug_log.push(record)) {
+    debug_log_lost = debug_log_lost + 1;
+  }
 }
 
-static void write_register(uint8_t reg, uint8_t data) {
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-  digitalWrite(pin_cs, LOW);
-  SPI.transfer(reg | SPI_WRITE);
-  SPI.transfer(data);
-  SPI.endTransaction();
-  digitalWrite(pin_cs, HIGH);
+// main loop only
+void RadioBase::print_debug_log() {
+  DebugRecord record;
+  while (debug_log.pop(record)) {
+    SerialUSB.print("[radio] ");
+    SerialUSB.print(record.time);
+    SerialUSB.print(" us ");
+    SerialUSB.print(debug_messages[record.event]);
+    if (record.length > 0) {
+      SerialUSB.print(" (");
+      SerialUSB.print(record.length);
+      SerialUSB.print(" B frame)");
+    }
+    SerialUSB.println();
+  }
+  uint16_t lost = debug_log_lost;
+  if (lost != debug_log_lost_reported) {
+    SerialUSB.print("[radio] debug messages lost: ");
+    SerialUSB.println(static_cast<uint16_t>(lost - debug_log_lost_reported));
+    debug_log_lost_reported = lost;
+  }
 }
 
-static void write_register(uint8_t reg, uint8_t value, uint8_t msb, uint8_t lsb) {
-  uint8_t currentValue = read_register(reg);
-  uint8_t newValue = currentValue & ((0b11111111 << (msb + 1)) & (0b11111111 >> (8 - lsb)));
-  write_register(reg, newValue | value);
+// tx_committed and tx_released count frames of each transmit queue (Priority as index)
+void RadioBase::tx_commit(uint8_t priority, uint8_t length) {
+  tx_committed[priority]++;
+  tx_queues[priority]->commit(length);
 }
 
-static void read_register_burst(uint8_t reg, uint8_t* data, uint8_t length) {
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-  digitalWrite(pin_cs, LOW);
-  SPI.transfer(reg | SPI_READ);
-  while(length--) {
-    *data = SPI.transfer(reg);
-    data++;
-  }
-  SPI.endTransaction();
-  digitalWrite(pin_cs, HIGH);
+void RadioBase::tx_release(uint8_t priority) {
+  tx_released[priority] = tx_released[priority] + 1;
+  tx_queues[priority]->release();
 }
 
-static void write_register_burst(uint8_t reg, uint8_t* data, uint8_t length) {
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-  digitalWrite(pin_cs, LOW);
-  SPI.transfer(reg | SPI_WRITE);
-  while(length--) {
-    SPI.transfer(*data);
-    data++;
+// frames in all transmit queues
+uint16_t RadioBase::queued_frames() const {
+  uint16_t frames = 0;
+  for (uint8_t i = 0; i < priorities; ++i) {
+    frames += tx_queues[i]->frames();
   }
-  SPI.endTransaction();
-  digitalWrite(pin_cs, HIGH);
+  return frames;
 }
 
 
@@ -162,6 +170,9 @@ static void write_register_burst(uint8_t reg, uint8_t* data, uint8_t length) {
 #define SX1278_MAX_POWER                              0b01110000  //  6     4     max power: P_max = 10.8 + 0.6*MAX_POWER [dBm]; P_max(MAX_POWER = 0b111) = 15 dBm
 #define SX1278_OUTPUT_POWER                           0b00001111  //  3     0     output power: P_out = 17 - (15 - OUTPUT_POWER) [dBm] for PA_SELECT_BOOST
 
+//SX1278_REG_PA_RAMP
+#define SX1278_PA_RAMP_40_US                          0b00001001  //  3     0     PA ramp up/down time: 40 us
+
 //SX1278_REG_OCP
 #define SX1278_OCP_OFF                                0b00000000  //  5     5     PA overload current protection disabled
 #define SX1278_OCP_ON                                 0b00100000  //  5     5     PA overload current protection enabled
@@ -215,6 +226,9 @@ static void write_register_burst(uint8_t reg, uint8_t* data, uint8_t length) {
 //SX1278_REG_SYMB_TIMEOUT_LSB
 #define SX1278_RX_TIMEOUT_LSB                         0b01100100  //  7     0     10 bit RX operation timeout
 
+//SX1278_REG_MAX_PAYLOAD_LENGTH
+#define SX1278_MAX_PAYLOAD_LENGTH                     0b11111111  //  7     0     maximum payload length, longer frames are dropped
+
 //SX1278_REG_PREAMBLE_MSB + REG_PREAMBLE_LSB
 #define SX1278_PREAMBLE_LENGTH_MSB                    0b00000000  //  7     0     2 byte preamble length setting: l_P = PREAMBLE_LENGTH + 4.25
 #define SX1278_PREAMBLE_LENGTH_LSB                    0b00001000  //  7     0         where l_p = preamble length
@@ -276,283 +290,1171 @@ static void write_register_burst(uint8_t reg, uint8_t* data, uint8_t length) {
 #define SX1278_FIFO_RX_BASE_ADDR_MAX                  0b00000000  //  7     0     allocate the entire FIFO buffer for RX only
 
 
-void setMode(uint8_t mode) {
-  write_register(SX1278_REG_OP_MODE, mode, 2, 0);
+uint8_t RadioBase::read_register(uint8_t reg) {
+  uint8_t inByte;
+  transport->read(reg, &inByte, 1);
+  return inByte;
+}
+
+// Registers the chip changes by itself (FIFO, IRQ flags) are never cached in the shadow.
+bool RadioBase::shadow_cacheable(uint8_t reg) {
+  static_assert(shadow_size == SX1278_REG_PLL + 1, "shadow has to cover all registers written by the library");
+  return reg < shadow_size && reg != SX1278_REG_FIFO && reg != SX1278_REG_IRQ_FLAGS;
+}
+
+bool RadioBase::shadow_valid(uint8_t reg) const {
+  return register_shadow_valid[reg / 8] & (1 << (reg % 8));
 }
-void clearIRQFlags() {
+
+void RadioBase::shadow_update(uint8_t reg, uint8_t value) {
+  if (shadow_cacheable(reg)) {
+    register_shadow[reg] = value;
+    register_shadow_valid[reg / 8] |= 1 << (reg % 8);
+  }
+}
+
+void RadioBase::write_register(uint8_t reg, uint8_t data) {
+  transport->write(reg, &data, 1);
+  shadow_update(reg, data);
+}
+
+// skips the transaction if the register already has the value
+void RadioBase::update_register(uint8_t reg, uint8_t value) {
+  if (!shadow_cacheable(reg) || !shadow_valid(reg) || register_shadow[reg] != value) {
+    write_register(reg, value);
+  }
+}
+
+void RadioBase::write_register(uint8_t reg, uint8_t value, uint8_t msb, uint8_t lsb) {
+  uint8_t currentValue = shadow_cacheable(reg) && shadow_valid(reg) ? register_shadow[reg] : read_register(reg);
+  uint8_t newValue = currentValue & ((0b11111111 << (msb + 1)) | (0b11111111 >> (8 - lsb)));
+  write_register(reg, newValue | value);
+}
+
+void RadioBase::read_register_burst(uint8_t reg, uint8_t* data, uint8_t length) {
+  transport->read(reg, data, length);
+}
+
+void RadioBase::write_register_burst(uint8_t reg, const uint8_t* data, uint8_t length) {
+  transport->write(reg, data, length);
+  // FIFO access does not increment the address
+  if (reg != SX1278_REG_FIFO) {
+    for (uint8_t i = 0; i < length; ++i) {
+      shadow_update(reg + i, data[i]);
+    }
+  }
+}
+
+// Register fields the chip changes on its own, skipped by shadow verification.
+static uint8_t volatile_bits(uint8_t reg) {
+  switch (reg) {
+    case SX1278_REG_OP_MODE:
+      // TX and RX single return to standby automatically
+      return 0b00000111;
+    case SX1278_REG_FIFO_ADDR_PTR:
+      // incremented on each FIFO access
+      return 0b11111111;
+    default:
+      return 0;
+  }
+}
+
+
+void RadioBase::set_op_mode(uint8_t op_mode) {
+  write_register(SX1278_REG_OP_MODE, op_mode, 2, 0);
+}
+void RadioBase::clear_irq_flags() {
   write_register(SX1278_REG_IRQ_FLAGS, 0b11111111);
 }
 
 
-void radio_interrupt();
+RadioBase::RadioBase(int pin_cs_, int pin_dio0_, const Config& config_, const Buffers& buffers)
+  : spi_transport(pin_cs_, pin_dio0_), transport(&spi_transport), config(config_),
+    tx_queues{buffers.tx[0], buffers.tx[1], buffers.tx[2]}, fifo_rx(*buffers.rx) {
+}
 
-enum class Mode {
-  Transmit,
-  Receive,
-};
-void set_mode(Mode);
+RadioBase::RadioBase(RadioTransport& transport_, const Config& config_, const Buffers& buffers)
+  : spi_transport(-1, -1), transport(&transport_), config(config_),
+    tx_queues{buffers.tx[0], buffers.tx[1], buffers.tx[2]}, fifo_rx(*buffers.rx) {
+}
 
-Radio::Radio(int pin_cs_, int pin_dio0_, float frequency_in_mhz_, Bandwidth bandwidth_, SpreadingFactor spreadingFactor_, CodingRate codingRate_) {
-  pin_cs = pin_cs_;
-  pin_dio0 = pin_dio0_;
-  frequency_in_mhz = frequency_in_mhz_;
-  bandwidth = bandwidth_;
-  spreadingFactor = spreadingFactor_;
-  codingRate = codingRate_;
+// Modem registers of given settings, written by begin() and (only the changed ones) by retune().
+static uint8_t modem_config_1(const RadioBase::Config& config) {
+  return static_cast<uint8_t>(config.bandwidth) | static_cast<uint8_t>(config.codingRate)
+         | (config.implicit_header_length > 0 ? SX1278_HEADER_IMPL_MODE : SX1278_HEADER_EXPL_MODE);
 }
 
-bool Radio::begin() {
-  pinMode(pin_dio0, INPUT);
-  pinMode(pin_cs, OUTPUT);
-  digitalWrite(pin_cs, HIGH);
-  
-  SPI.begin();
+static uint8_t modem_config_2(const RadioBase::Config& config) {
+  return static_cast<uint8_t>(config.spreadingFactor) | SX1278_TX_MODE_SINGLE | SX1278_RX_CRC_MODE_ON | SX1278_RX_TIMEOUT_MSB;
+}
+
+static uint8_t modem_config_3(const RadioBase::Config& config) {
+  return (config.low_data_rate_optimize() ? SX1278_LOW_DATA_RATE_OPT_ON : SX1278_LOW_DATA_RATE_OPT_OFF) | SX1278_AGC_AUTO_ON;
+}
+
+static bool sf6(const RadioBase::Config& config) {
+  return config.spreadingFactor == RadioBase::SpreadingFactor::_6;
+}
+
+bool RadioBase::valid_config(const Config& config_) {
+  if (sf6(config_) && config_.implicit_header_length == 0) {
+    if (debug_enabled) {
+      SerialUSB.println("[radio] SF6 requires implicit header!");
+    }
+    return false;
+  }
+  if (aggregation && config_.implicit_header_length > 0) {
+    if (debug_enabled) {
+      SerialUSB.println("[radio] no aggregation with implicit header!");
+    }
+    return false;
+  }
+  return true;
+}
+
+bool RadioBase::begin() {
+  bool implicit_header = config.implicit_header_length > 0;
+  if (!valid_config(config)) {
+    return false;
+  }
+  initialised = false;
+  tdma_airtime_us = config.time_on_air(tdma_airtime_length);
+
+  transport->begin();
   
+  // chip might have been reset since last begin()
+  memset(register_shadow_valid, 0, sizeof(register_shadow_valid));
+
   uint8_t version = read_register(SX1278_REG_VERSION);
   if(version != 0x12) {
-    SPI.end();
+    transport->end();
     if (debug_enabled) {
       SerialUSB.println("[radio] Not responding!");
     }
     return false;
   }
   
-  setMode(SX1278_SLEEP);
+  // LoRa mode can be selected only in sleep
+  write_register(SX1278_REG_OP_MODE, SX1278_FSK_OOK | SX1278_LOW_FREQ | SX1278_SLEEP);
+  write_register(SX1278_REG_OP_MODE, SX1278_LORA | SX1278_LOW_FREQ | SX1278_SLEEP);
   
-  write_register(SX1278_REG_OP_MODE, SX1278_LORA, 7, 7);
-  
-  // set carrier frequency
-  constexpr float step_in_mhz = 32/pow(2, 19);
-  float multiplier = frequency_in_mhz/step_in_mhz;
-  auto multiplier_int = static_cast<uint32_t>(multiplier);
-  
-  write_register(SX1278_REG_FRF_MSB, (multiplier_int >> 16) & 0xFF);
-  write_register(SX1278_REG_FRF_MID, (multiplier_int >> 8) & 0xFF);
-  write_register(SX1278_REG_FRF_LSB, multiplier_int & 0xFF);
-  
-  
-  // output power configuration
-  write_register(SX1278_REG_PA_CONFIG, SX1278_PA_SELECT_BOOST | SX1278_MAX_POWER | SX1278_OUTPUT_POWER);
-  write_register(SX1278_REG_OCP, SX1278_OCP_ON | SX1278_OCP_TRIM, 5, 0);
-  write_register(SX1278_REG_LNA, SX1278_LNA_GAIN_1 | SX1278_LNA_BOOST_HF_ON);
+  // carrier frequency and output power configuration (SX1278_REG_FRF_MSB - SX1278_REG_LNA)
+  const uint8_t rf_registers[] = {
+    config.frequency[0],
+    config.frequency[1],
+    config.frequency[2],
+    SX1278_PA_SELECT_BOOST | SX1278_MAX_POWER | SX1278_OUTPUT_POWER,
+    SX1278_PA_RAMP_40_US,
+    SX1278_OCP_ON | SX1278_OCP_TRIM,
+    SX1278_LNA_GAIN_1 | SX1278_LNA_BOOST_HF_ON,
+  };
+  write_register_burst(SX1278_REG_FRF_MSB, rf_registers, sizeof(rf_registers));
   write_register(SX1278_REG_PA_DAC, SX1278_PA_BOOST_ON, 2, 0);
   
-  // turn off frequency hopping
-  write_register(SX1278_REG_HOP_PERIOD, SX1278_HOP_PERIOD_OFF);
+  static_assert(((SX1278_PREAMBLE_LENGTH_MSB << 8) | SX1278_PREAMBLE_LENGTH_LSB) == preamble_length, "time on air assumes different preamble");
   
-  // basic setting (bw, cr, sf, header mode and CRC)
-  write_register(SX1278_REG_MODEM_CONFIG_2, static_cast<uint8_t>(spreadingFactor) | SX1278_TX_MODE_SINGLE | SX1278_RX_CRC_MODE_ON, 7, 2);
-  write_register(SX1278_REG_MODEM_CONFIG_1, static_cast<uint8_t>(bandwidth) | static_cast<uint8_t>(codingRate) | SX1278_HEADER_EXPL_MODE);
+  // basic setting (bw, cr, sf, header mode and CRC), preamble and frequency hopping off
+  // (SX1278_REG_MODEM_CONFIG_1 - SX1278_REG_HOP_PERIOD)
+  const uint8_t modem_registers[] = {
+    modem_config_1(config),
+    modem_config_2(config),
+    SX1278_RX_TIMEOUT_LSB,
+    SX1278_PREAMBLE_LENGTH_MSB,
+    SX1278_PREAMBLE_LENGTH_LSB,
+    // expected length of received frames in implicit header mode, otherwise set for each transmitted frame
+    implicit_header ? config.implicit_header_length : static_cast<uint8_t>(1),
+    SX1278_MAX_PAYLOAD_LENGTH,
+    SX1278_HOP_PERIOD_OFF,
+  };
+  write_register_burst(SX1278_REG_MODEM_CONFIG_1, modem_registers, sizeof(modem_registers));
   
-  write_register(SX1278_REG_MODEM_CONFIG_3, SX1278_LOW_DATA_RATE_OPT_ON | SX1278_AGC_AUTO_ON, 3, 2);
+  write_register(SX1278_REG_MODEM_CONFIG_3, modem_config_3(config));
   
-  write_register(SX1278_REG_DETECT_OPTIMIZE, SX1278_DETECT_OPTIMIZE_SF_7_12, 2, 0);
-  write_register(SX1278_REG_DETECTION_THRESHOLD, SX1278_DETECTION_THRESHOLD_SF_7_12);
+  write_register(SX1278_REG_DETECT_OPTIMIZE, sf6(config) ? SX1278_DETECT_OPTIMIZE_SF_6 : SX1278_DETECT_OPTIMIZE_SF_7_12, 2, 0);
+  write_register(SX1278_REG_DETECTION_THRESHOLD, sf6(config) ? SX1278_DETECTION_THRESHOLD_SF_6 : SX1278_DETECTION_THRESHOLD_SF_7_12);
   
   // set mode to STANDBY
-  setMode(SX1278_STANDBY);
+  set_op_mode(SX1278_STANDBY);
   
-  clearIRQFlags();
+  clear_irq_flags();
   
-  SPI.usingInterrupt(digitalPinToInterrupt(pin_dio0));
-  attachInterrupt(digitalPinToInterrupt(pin_dio0), radio_interrupt, HIGH);
+  if (!transport->attach_interrupt(interrupt, this)) {
+    transport->end();
+    if (debug_enabled) {
+      SerialUSB.println("[radio] No interrupt left for DIO0!");
+    }
+    return false;
+  }
   
+  // set_mode() logs to debug_log, filled only by the interrupt or with it blocked
+  transport->block_interrupt();
   set_mode(Mode::Receive);
+  initialised = true;
+  transport->unblock_interrupt();
   
   return true;
 }
 
 // ALL modes
 
+static void count_time(uint32_t* histogram, uint32_t us) {
+  uint8_t bin = us == 0 ? 0 : 32 - __builtin_clz(us);
+  histogram[bin < RadioBase::histogram_bins ? bin : RadioBase::histogram_bins - 1]++;
+}
 
+void RadioBase::disable_debug() {
+  debug_enabled = false;
+}
 
-volatile static Mode mode;
-static uint8_t frame_buffer[256];
-volatile static uint8_t frames_in_rx_fifo = 0;
+void RadioBase::enable_debug() {
+  debug_enabled = true;
+}
 
-void Radio::disable_debug() {
-  debug_enabled = false;
+bool RadioBase::verify_registers() {
+  bool ok = true;
+  for (uint8_t reg = 0; reg < shadow_size; ++reg) {
+    if (!shadow_cacheable(reg) || !shadow_valid(reg)) {
+      continue;
+    }
+    uint8_t mask = ~volatile_bits(reg);
+    uint8_t actual = read_register(reg);
+    if ((actual & mask) != (register_shadow[reg] & mask)) {
+      ok = false;
+      if (debug_enabled) {
+        SerialUSB.print("[radio] register 0x");
+        SerialUSB.print(reg, HEX);
+        SerialUSB.print(" shadow 0x");
+        SerialUSB.print(register_shadow[reg], HEX);
+        SerialUSB.print(" chip 0x");
+        SerialUSB.println(actual, HEX);
+      }
+    }
+  }
+  return ok;
 }
 
-void set_mode(Mode mode_) {
-  if (debug_enabled) {
-    SerialUSB.print("[radio] change mode ");
+void RadioBase::set_mode(Mode mode_) {
+  if (mode_ != mode) {
+    radio_stats.mode_switches++;
   }
-  
   mode = mode_;
-  clearIRQFlags();
-  setMode(SX1278_STANDBY);
+  tx_previous_frame = false;
+  // standby below aborts it
+  cad_running = false;
+  clear_irq_flags();
+  set_op_mode(SX1278_STANDBY);
   
   if (mode == Mode::Transmit) {
-    if (debug_enabled) {
-      SerialUSB.println("to TX");
-    }
-    setMode(SX1278_STANDBY);
+    log_debug(DEBUG_MODE_TX);
+    set_op_mode(SX1278_STANDBY);
 
     write_register(SX1278_REG_DIO_MAPPING_1, SX1278_DIO0_TX_DONE, 7, 6);
     
   } else if (mode == Mode::Receive) {    
-    if (debug_enabled) {
-      SerialUSB.println("to RX");
-    }
+    log_debug(DEBUG_MODE_RX);
     write_register(SX1278_REG_DIO_MAPPING_1, SX1278_DIO0_RX_DONE, 7, 4);
     
     write_register(SX1278_REG_FIFO_RX_BASE_ADDR, SX1278_FIFO_RX_BASE_ADDR_MAX);
     write_register(SX1278_REG_FIFO_ADDR_PTR, SX1278_FIFO_RX_BASE_ADDR_MAX);
     
-    setMode(SX1278_RXCONTINUOUS);
+    set_op_mode(SX1278_RXCONTINUOUS);
   }
 }
 
 
 
-void radio_interrupt() {
-  clearIRQFlags();
-  
-  if (mode == Mode::Transmit) {
-    if (fifo_tx.size() > 0) {
-      auto length = fifo_tx.get();
-    
-      write_register(SX1278_REG_PAYLOAD_LENGTH, length);
-      write_register(SX1278_REG_FIFO_TX_BASE_ADDR, SX1278_FIFO_TX_BASE_ADDR_MAX);
-      write_register(SX1278_REG_FIFO_ADDR_PTR, SX1278_FIFO_TX_BASE_ADDR_MAX);    
-      
-      for(uint16_t i = 0; i < length; ++i) {
-        frame_buffer[i] = fifo_tx.get();
+// Highest priority queue with a frame, unless a lower one has waited too long, -1 if all are empty.
+int8_t RadioBase::next_queue() const {
+  int8_t next = -1;
+  for (uint8_t i = 0; i < priorities; ++i) {
+    if (tx_queues[i]->frames() > 0) {
+      if (priority_aging > 0 && tx_waited[i] >= priority_aging) {
+        return i;
       }
-      
-      write_register_burst(SX1278_REG_FIFO, frame_buffer, length);
-      setMode(SX1278_TX);
-    } else {
-      if (debug_enabled) {
-        SerialUSB.println("[radio] cleared TX queue");
+      if (next < 0) {
+        next = i;
       }
-      set_mode(Mode::Receive);
     }
-  } else if (mode == Mode::Receive) {
-    if (read_register(SX1278_REG_IRQ_FLAGS, 5, 5) == SX1278_CLEAR_IRQ_FLAG_PAYLOAD_CRC_ERROR) {
-      if (debug_enabled) {
-        SerialUSB.println("[radio] CRC fail!");
-      }
-      return;
+  }
+  return next;
+}
+
+// Length of the frame next_frame() would return, 0 if none (interrupt only).
+uint8_t RadioBase::next_frame_length() {
+  int8_t next = next_queue();
+  uint8_t length = 0;
+  if (next >= 0) {
+    tx_queues[next]->peek(length);
+  }
+  return length;
+}
+
+// Frame to send next, counts the wait of lower priorities for aging (interrupt only).
+const uint8_t* RadioBase::next_frame(uint8_t& length, uint8_t& priority) {
+  int8_t next = next_queue();
+  for (uint8_t i = 0; i < priorities; ++i) {
+    if (tx_queues[i]->frames() == 0) {
+      tx_waited[i] = 0;
+    } else if (i > next && tx_waited[i] < 255) {
+      tx_waited[i]++;
     }
-    
-    auto length = read_register(SX1278_REG_RX_NB_BYTES);
-    read_register_burst(SX1278_REG_FIFO, frame_buffer, length);
-
-    if (fifo_rx.free_space() > length+1u) {
-      frames_in_rx_fifo++;
-      
-      fifo_rx.append(length);
-      
-      for(uint16_t i = 0; i < length; ++i) {
-        fifo_rx.append(frame_buffer[i]);
+  }
+  if (next < 0) {
+    return nullptr;
+  }
+  tx_waited[next] = 0;
+  priority = next;
+  return tx_queues[priority]->peek(length);
+}
+
+void RadioBase::interrupt(void* radio) {
+  static_cast<RadioBase*>(radio)->radio_interrupt();
+}
+
+// Channel activity detection before the next frame (listen before talk), DIO0 signals CAD done.
+void RadioBase::start_cad() {
+  write_register(SX1278_REG_DIO_MAPPING_1, SX1278_DIO0_CAD_DONE, 7, 6);
+  cad_running = true;
+  set_op_mode(SX1278_CAD);
+}
+
+// Channel busy: listen for a random time, poll() resumes the transmission (interrupt only).
+void RadioBase::back_off() {
+  radio_stats.channel_busy++;
+  log_debug(DEBUG_CHANNEL_BUSY);
+  // xorshift32
+  lbt_random ^= lbt_random << 13;
+  lbt_random ^= lbt_random >> 17;
+  lbt_random ^= lbt_random << 5;
+  tx_resume_time = micros() + lbt_random % (lbt_max_backoff_us + 1);
+  tx_waiting = true;
+  set_mode(Mode::Receive);
+}
+
+// Frame of given length can start now and end within the TDMA slot (interrupt only).
+// A frame longer than the slot goes first at its start.
+// Slot the module is in or the next one as micros() values, so the interrupt
+// only compares times (main loop, interrupt blocked).
+void RadioBase::update_tdma_slot() {
+  if (!tdma_synchronised) {
+    return;
+  }
+  uint32_t now = micros();
+  uint32_t position = (now - tdma_epoch) % tdma_period_us;
+  // wraps to a large value before the slot
+  uint32_t offset = position - tdma_slot_start_us;
+  if (offset < tdma_slot_length_us) {
+    tdma_slot_begin = now - offset;
+  } else {
+    tdma_slot_begin = now + (tdma_slot_start_us + tdma_period_us - position) % tdma_period_us;
+  }
+}
+
+// Interrupt only: time on air is kept for the last length, frames of a node usually have equal length.
+bool RadioBase::fits_tdma_slot(uint8_t length) {
+  if (!tdma_synchronised) {
+    return false;
+  }
+  if (length != tdma_airtime_length) {
+    tdma_airtime_length = length;
+    tdma_airtime_us = time_on_air(length);
+  }
+  // wraps to a large value before the slot (or after a slot long ago, until poll() updates it)
+  uint32_t offset = micros() - tdma_slot_begin;
+  uint32_t airtime = tdma_airtime_us;
+  return offset < tdma_slot_length_us &&
+         (offset + airtime <= tdma_slot_length_us || (airtime > tdma_slot_length_us && !tx_previous_frame));
+}
+
+// Outside of the slot: listen until the next one starts, poll() resumes the transmission (interrupt only).
+void RadioBase::wait_for_slot() {
+  radio_stats.slot_waits++;
+  log_debug(DEBUG_WAIT_FOR_SLOT);
+  uint32_t now = micros();
+  if (!tdma_synchronised) {
+    // without a slot until set_tdma_slot()
+    tx_resume_time = now + 0x7FFFFFFF;
+  } else if (static_cast<int32_t>(tdma_slot_begin - now) > 0) {
+    tx_resume_time = tdma_slot_begin;
+  } else {
+    // slot of the next period (in the past if the slot is old, poll() finds the current one)
+    tx_resume_time = tdma_slot_begin + tdma_period_us;
+  }
+  tx_waiting = true;
+  set_mode(Mode::Receive);
+}
+
+// After a backoff or outside of the TDMA slot (main loop only).
+void RadioBase::resume_transmission() {
+  if (!tx_waiting || static_cast<int32_t>(micros() - tx_resume_time) < 0) {
+    return;
+  }
+  transport->block_interrupt();
+  tx_waiting = false;
+  update_tdma_slot();
+  if (mode != Mode::Transmit) {
+    set_mode(Mode::Transmit);
+    log_debug(DEBUG_FORCE_INTERRUPT);
+    radio_interrupt();
+  }
+  transport->unblock_interrupt();
+}
+
+void RadioBase::radio_interrupt() {
+  uint32_t start = micros();
+  if (mode == Mode::Transmit) {
+    bool cad_done = cad_running;
+    bool channel_busy = false;
+    if (cad_done) {
+      cad_running = false;
+      channel_busy = read_register(SX1278_REG_IRQ_FLAGS) & SX1278_CLEAR_IRQ_FLAG_CAD_DETECTED;
+      clear_irq_flags();
+      if (!channel_busy) {
+        write_register(SX1278_REG_DIO_MAPPING_1, SX1278_DIO0_TX_DONE, 7, 6);
       }
     } else {
-      if (debug_enabled) {
-        SerialUSB.println("[radio] RX buffer full!");
+      clear_irq_flags();
+    }
+
+    uint8_t length, priority;
+    const uint8_t* frame;
+    if (channel_busy) {
+      back_off();
+    } else if (tdma && (length = next_frame_length()) > 0 && !fits_tdma_slot(length)) {
+      wait_for_slot();
+    } else if (listen_before_talk && !cad_done && queued_frames() > 0) {
+      start_cad();
+    } else if ((frame = next_frame(length, priority)) != nullptr) {
+      // the module is idle until TX starts again and the FIFO can be written only in standby,
+      // so only changed registers are written (length of equal frames, base address once)
+      update_register(SX1278_REG_PAYLOAD_LENGTH, length);
+      update_register(SX1278_REG_FIFO_TX_BASE_ADDR, SX1278_FIFO_TX_BASE_ADDR_MAX);
+      write_register(SX1278_REG_FIFO_ADDR_PTR, SX1278_FIFO_TX_BASE_ADDR_MAX);
+
+      write_register_burst(SX1278_REG_FIFO, frame, length);
+      tx_release(priority);
+      set_op_mode(SX1278_TX);
+
+      uint32_t now = micros();
+      if (tx_previous_frame) {
+        // interrupt latency and frame upload, predicted end can be a little late
+        int32_t gap = static_cast<int32_t>(now - tx_end_time);
+        count_time(radio_stats.tx_gap, gap > 0 ? gap : 0);
       }
-    } 
+      tx_previous_frame = true;
+      radio_stats.frames_sent++;
+      radio_stats.bytes_sent += length;
+
+      auto airtime = time_on_air(length);
+      tx_end_time = now + airtime;
+      tx_airtime_started = tx_airtime_started + airtime;
+    } else {
+      log_debug(DEBUG_TX_QUEUE_CLEARED);
+      tx_drained = tx_drained + 1;
+      set_mode(Mode::Receive);
+    }
+  } else if (mode == Mode::Receive) {
+    receive_frame();
+  }
+  count_time(radio_stats.interrupt_time, micros() - start);
+}
+
+// SX1278_REG_FIFO_RX_CURRENT_ADDR - SX1278_REG_PKT_RSSI_VALUE read in one burst
+static constexpr uint8_t rx_status_length = SX1278_REG_PKT_RSSI_VALUE - SX1278_REG_FIFO_RX_CURRENT_ADDR + 1;
+
+static uint8_t rx_status(const uint8_t* status, uint8_t reg) {
+  return status[reg - SX1278_REG_FIFO_RX_CURRENT_ADDR];
+}
+
+void RadioBase::receive_frame() {
+  uint8_t status[rx_status_length];
+  read_register_burst(SX1278_REG_FIFO_RX_CURRENT_ADDR, status, sizeof(status));
+  // flags are read before clearing, only these are cleared
+  uint8_t flags = rx_status(status, SX1278_REG_IRQ_FLAGS);
+  write_register(SX1278_REG_IRQ_FLAGS, flags);
+
+  last_snr = rx_status(status, SX1278_REG_PKT_SNR_VALUE);
+  last_rssi = rx_status(status, SX1278_REG_PKT_RSSI_VALUE);
+
+  if (flags & SX1278_CLEAR_IRQ_FLAG_PAYLOAD_CRC_ERROR) {
+    radio_stats.crc_errors++;
+    log_debug(DEBUG_CRC_FAIL, rx_status(status, SX1278_REG_RX_NB_BYTES));
+    return;
+  }
+
+  auto length = rx_status(status, SX1278_REG_RX_NB_BYTES);
+  if (length == 0) {
+    return;
+  }
+
+  // container records have the same format as fifo_rx, no need to split them one by one,
+  // a single frame gets its length byte
+  uint16_t records_size = aggregation ? length : length + 1u;
+  auto records = fifo_rx.reserve_records(rx_header_size + records_size);
+  if (!records) {
+    radio_stats.rx_overflows++;
+    log_debug(DEBUG_RX_BUFFER_FULL, length);
+    return;
+  }
+
+  RxStatus frame_status;
+  frame_status.time = micros();
+  frame_status.snr = last_snr;
+  frame_status.rssi = last_rssi;
+  frame_status.records_size = records_size;
+  read_register_burst(SX1278_REG_FEI_MSB, frame_status.frequency_error, sizeof(frame_status.frequency_error));
+  records[0] = sizeof(RxStatus);
+  memcpy(&records[1], &frame_status, sizeof(RxStatus));
+  records += rx_header_size;
+
+  // frames follow each other in the module FIFO (also ones with CRC errors, never read)
+  write_register(SX1278_REG_FIFO_ADDR_PTR, rx_status(status, SX1278_REG_FIFO_RX_CURRENT_ADDR));
+
+  if (!aggregation) {
+    *records++ = length;
+  }
+  read_register_burst(SX1278_REG_FIFO, records, length);
+  if (fifo_rx.commit_records(rx_header_size + records_size, 1) > 0) {
+    count_received(length);
+  } else {
+    log_debug(DEBUG_MALFORMED_AGGREGATE, length);
+  }
+}
+
+void RadioBase::count_received(uint8_t length) {
+  radio_stats.frames_received++;
+  radio_stats.bytes_received += length;
+  auto frames = fifo_rx.frames();
+  if (frames > radio_stats.rx_frames_max) {
+    radio_stats.rx_frames_max = frames;
   }
 }
 
   
 // TX mode
 
-bool Radio::transmit(Frame frame) {
-  return transmit(frame.operator const char*());
+bool RadioBase::transmit(const Frame& frame, Priority priority) {
+  auto buffer = reserve(frame.size + 1u, priority);
+  if (!buffer) {
+    return false;
+  }
+  memcpy(buffer, frame.buffer, frame.size);
+  // transmit frame with the null-termination character included
+  buffer[frame.size] = '\0';
+  return commit(frame.size + 1u);
 }
 
-bool Radio::transmit(const char* str) {
+bool RadioBase::transmit(const char* str, Priority priority) {
   auto length = strlen(str);
   if (length >= 255) {
     return false;
   }
   // transmit frame with the null-termination character included
-  return transmit(reinterpret_cast<const uint8_t*>(str), length + 1);
+  return transmit(reinterpret_cast<const uint8_t*>(str), length + 1, priority);
 }
 
-bool Radio::transmit(String str) {
-  return transmit(str.c_str());
+bool RadioBase::transmit(String str, Priority priority) {
+  return transmit(str.c_str(), priority);
+}
+
+bool RadioBase::transmit(const uint8_t* data, uint8_t length, Priority priority) {
+  auto buffer = reserve(length, priority);
+  if (!buffer) {
+    return false;
+  }
+  memcpy(buffer, data, length);
+  return commit(length);
+}
+
+bool RadioBase::transmit_latest(uint8_t key, const uint8_t* data, uint8_t length, Priority priority) {
+  if (key >= latest_keys) {
+    return false;
+  }
+  auto& previous = latest[key];
+  uint8_t lane = static_cast<uint8_t>(priority);
+  if (previous.data && previous.length == length && previous.priority == lane) {
+    // interrupt blocked, so it does not start sending the frame in the meantime
+    transport->block_interrupt();
+    bool waiting = static_cast<int32_t>(tx_released[lane] - previous.frame) <= 0;
+    if (waiting) {
+      memcpy(previous.data, data, length);
+      radio_stats.tx_replaced++;
+    }
+    transport->unblock_interrupt();
+    if (waiting) {
+      return true;
+    }
+  }
+
+  auto buffer = reserve(length, priority);
+  if (!buffer) {
+    return false;
+  }
+  memcpy(buffer, data, length);
+  previous = LatestFrame{buffer, length, lane, tx_committed[lane]};
+  return commit(length);
 }
 
-bool Radio::transmit(const uint8_t* data, uint8_t length) {
+void RadioBase::set_drop_oldest(bool enabled) {
+  tx_drop_oldest = enabled;
+}
+
+// put committed frame into the transmit queue and start transmission if radio is idle
+void RadioBase::queue_frame(uint8_t priority, uint8_t length) {
+  // counted before the frame is visible to the interrupt, so queued airtime never goes negative
+  tx_airtime_queued = tx_airtime_queued + time_on_air(length);
+  tx_commit(priority, length);
+  // only the main loop writes it
+  uint16_t frames = queued_frames();
+  if (frames > radio_stats.tx_frames_max) {
+    radio_stats.tx_frames_max = frames;
+  }
+
+  // mode has to be read after the frame is published:
+  // if TX interrupt has already switched to RX, it did not see the frame
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (mode == Mode::Transmit) {
+    return;
+  }
+
+  // radio is idle - switch to TX, interrupt blocked only for the mode change;
+  // after a busy channel poll() does it when the backoff is over
+  transport->block_interrupt();
+  
+  if (mode != Mode::Transmit && !tx_waiting) {
+    update_tdma_slot();
+    set_mode(Mode::Transmit);
+    log_debug(DEBUG_FORCE_INTERRUPT);
+    radio_interrupt();
+  }
+  
+  transport->unblock_interrupt();
+}
+
+void RadioBase::close_container() {
+  if (container && container_used > 0) {
+    queue_frame(container_priority, container_used);
+  }
+  // empty container is not committed, space is reserved again for the next one
+  container = nullptr;
+  container_used = 0;
+}
+
+// Remove the oldest waiting frame of the queue, false if there is none.
+bool RadioBase::drop_oldest_frame(uint8_t priority) {
+  transport->block_interrupt();
+  uint8_t length;
+  bool dropped = tx_queues[priority]->peek(length) != nullptr;
+  if (dropped) {
+    // as if it was sent
+    tx_airtime_started = tx_airtime_started + time_on_air(length);
+    tx_release(priority);
+    radio_stats.tx_dropped++;
+  }
+  transport->unblock_interrupt();
+  return dropped;
+}
+
+uint8_t* RadioBase::reserve_frame(uint8_t priority, uint8_t length) {
+  auto buffer = tx_queues[priority]->reserve(length);
+  while (!buffer && tx_drop_oldest && drop_oldest_frame(priority)) {
+    buffer = tx_queues[priority]->reserve(length);
+  }
+  return buffer;
+}
+
+uint8_t* RadioBase::reserve(uint8_t length, Priority priority) {
+  print_debug_log();
   if (length == 0) {
     if (debug_enabled) {
       SerialUSB.println("[radio] empty frame!");
     }
-    return false;
+    return nullptr;
+  }
+  if (tx_reserved) {
+    if (debug_enabled) {
+      SerialUSB.println("[radio] frame already reserved!");
+    }
+    return nullptr;
+  }
+  if (length > max_frame_length()) {
+    if (debug_enabled) {
+      SerialUSB.println(aggregation ? "[radio] frame too long for aggregation!" : "[radio] frame too long for implicit header!");
+    }
+    return nullptr;
+  }
+  uint8_t* buffer;
+  uint8_t lane = static_cast<uint8_t>(priority);
+  if (aggregation) {
+    // messages of different priority go in separate containers
+    if (container && (container_used + length + 1u > 255 || container_priority != lane)) {
+      close_container();
+    }
+    if (!container) {
+      container = reserve_frame(lane, 255);
+      container_priority = lane;
+    }
+    // one byte of the container for the record length
+    buffer = container ? container + container_used + 1 : nullptr;
+  } else {
+    // whole frame of fixed length, padded in commit()
+    tx_reserved_length = config.implicit_header_length > 0 ? config.implicit_header_length : length;
+    buffer = tx_reserved_frame = reserve_frame(lane, tx_reserved_length);
+    tx_reserved_priority = lane;
   }
-  if (fifo_tx.free_space() < length+1u) {
+  if (!buffer) {
+    radio_stats.tx_full++;
     if (debug_enabled) {
       SerialUSB.println("[radio] TX buffer full!");
     }
+    return nullptr;
+  }
+  tx_reserved = true;
+  return buffer;
+}
+
+bool RadioBase::commit(uint8_t length) {
+  if (!tx_reserved) {
+    return false;
+  }
+  tx_reserved = false;
+  if (length == 0) {
     return false;
   }
 
-  // begin transaction just to block interrupt
-  SPI.beginTransaction(SPISettings(2000000, MSBFIRST, SPI_MODE0));
-  
-  auto mode_switch = false;
-  if (mode != Mode::Transmit) {
-    mode_switch = true;
-    set_mode(Mode::Transmit);
+  if (aggregation) {
+    if (container_used == 0) {
+      container_first_message_time = micros();
+    }
+    container[container_used] = length;
+    container_used += length + 1u;
+    // no space left even for 1-byte message, high priority is not delayed
+    if (container_used >= 254 || container_priority == static_cast<uint8_t>(Priority::High)) {
+      close_container();
+    } else if (micros() - container_first_message_time >= aggregation_max_delay_us) {
+      // deadline also without poll(), callbacks run only from poll()
+      close_container();
+    }
+    return true;
   }
-  
-  fifo_tx.append(length);
-  for (int i = 0; i < length; ++i) {
-    fifo_tx.append(data[i]);
+
+  if (length > tx_reserved_length) {
+    return false;
   }
-  
-  if (mode_switch) {
+  if (config.implicit_header_length > 0) {
+    memset(tx_reserved_frame + length, 0, tx_reserved_length - length);
+    length = tx_reserved_length;
+  }
+  queue_frame(tx_reserved_priority, length);
+  return true;
+}
+
+void RadioBase::enable_aggregation(std::uint16_t max_delay_ms) {
+  if (config.implicit_header_length > 0) {
     if (debug_enabled) {
-      SerialUSB.println("[radio] force interrupt");
+      SerialUSB.println("[radio] no aggregation with implicit header!");
     }
-    radio_interrupt();
+    return;
   }
-  
-  SPI.endTransaction();
-  
+  aggregation_max_delay_us = max_delay_ms * 1000ul;
+  aggregation = true;
+}
+
+void RadioBase::disable_aggregation() {
+  if (!tx_reserved) {
+    close_container();
+    aggregation = false;
+  }
+}
+
+uint8_t RadioBase::max_frame_length() const {
+  if (config.implicit_header_length > 0) {
+    return config.implicit_header_length;
+  }
+  return aggregation ? 254 : 255;
+}
+
+void RadioBase::enable_listen_before_talk(std::uint16_t max_backoff_ms) {
+  lbt_max_backoff_us = max_backoff_ms * 1000ul;
+  // seed, so that nodes started together back off differently
+  if (lbt_random == 0) {
+    lbt_random = micros() | 1;
+  }
+  listen_before_talk = true;
+}
+
+void RadioBase::disable_listen_before_talk() {
+  listen_before_talk = false;
+  // frame waiting for the end of a backoff is sent right away
+  tx_resume_time = micros();
+  resume_transmission();
+}
+
+void RadioBase::enable_tdma() {
+  transport->block_interrupt();
+  tdma = true;
+  tdma_synchronised = false;
+  transport->unblock_interrupt();
+}
+
+bool RadioBase::set_tdma_slot(uint32_t epoch_us, uint32_t period_us, uint32_t slot_start_us, uint32_t slot_length_us) {
+  if (slot_length_us == 0 || slot_start_us + slot_length_us > period_us) {
+    if (debug_enabled) {
+      SerialUSB.println("[radio] TDMA slot outside of the period!");
+    }
+    return false;
+  }
+  transport->block_interrupt();
+  tdma_epoch = epoch_us;
+  tdma_period_us = period_us;
+  tdma_slot_start_us = slot_start_us;
+  tdma_slot_length_us = slot_length_us;
+  tdma = true;
+  tdma_synchronised = true;
+  update_tdma_slot();
+  transport->unblock_interrupt();
+  // waiting frames check the new slot
+  tx_resume_time = micros();
+  resume_transmission();
   return true;
 }
 
-void Radio::flush() {
-  while (mode != Mode::Receive);
+void RadioBase::disable_tdma() {
+  tdma = false;
+  tx_resume_time = micros();
+  resume_transmission();
+}
+
+void RadioBase::poll() {
+  print_debug_log();
+  resume_transmission();
+  if (aggregation && !tx_reserved && container_used > 0 && micros() - container_first_message_time >= aggregation_max_delay_us) {
+    close_container();
+  }
+
+  // callback may remove itself
+  uint8_t length;
+  FrameInfo info;
+  const uint8_t* frame;
+  while (receive_callback && (frame = peek(length, info)) != nullptr) {
+    receive_callback(frame, length, info);
+    release();
+  }
+
+  uint16_t drained = tx_drained;
+  if (drained != tx_drained_handled) {
+    tx_drained_handled = drained;
+    if (transmit_callback) {
+      transmit_callback();
+    }
+  }
+}
+
+void RadioBase::on_receive(ReceiveCallback callback) {
+  receive_callback = callback;
+}
+
+void RadioBase::on_transmit_done(TransmitCallback callback) {
+  tx_drained_handled = tx_drained;
+  transmit_callback = callback;
+}
+
+uint32_t RadioBase::time_on_air(uint8_t length) const {
+  return config.time_on_air(length);
+}
+
+uint32_t RadioBase::tx_queue_time() const {
+  uint32_t queued = tx_airtime_queued - tx_airtime_started;
+  if (mode == Mode::Transmit) {
+    int32_t remaining = tx_end_time - micros();
+    if (remaining > 0) {
+      queued += remaining;
+    }
+  }
+  return queued;
+}
+
+uint32_t RadioBase::transmit_delay(uint8_t length) const {
+  return tx_queue_time() + time_on_air(length);
 }
 
-bool Radio::tx_fifo_empty() {
-  return fifo_tx.size() == 0;
+// Frames held until the first TDMA slot wait for a beacon handled by the caller, not for flush().
+bool RadioBase::tx_in_progress() const {
+  return mode != Mode::Receive || (tx_waiting && (!tdma || tdma_synchronised));
+}
+
+void RadioBase::flush() {
+  if (!tx_reserved) {
+    close_container();
+  }
+  while (tx_in_progress()) {
+    print_debug_log();
+    resume_transmission();
+    yield();
+  }
+  print_debug_log();
+}
+
+bool RadioBase::flush(uint32_t timeout_ms) {
+  if (!tx_reserved) {
+    close_container();
+  }
+  uint32_t start = millis();
+  while (tx_in_progress()) {
+    print_debug_log();
+    resume_transmission();
+    if (millis() - start >= timeout_ms) {
+      return false;
+    }
+    yield();
+  }
+  print_debug_log();
+  return !tx_waiting;
+}
+
+bool RadioBase::tx_fifo_empty() const {
+  return queued_frames() == 0 && container_used == 0;
+}
+
+void RadioBase::set_priority_aging(uint8_t frames) {
+  priority_aging = frames;
 }
 
 
 // RX mode
 
-std::uint8_t Radio::available() {
-  return frames_in_rx_fifo;
+std::uint8_t RadioBase::available() {
+  print_debug_log();
+  auto frames = fifo_rx.frames();
+  return frames > 255 ? 255 : frames;
 }
 
-void Radio::receive(char* data) {
+void RadioBase::receive(char* data) {
   uint8_t dummy;
   receive((uint8_t*)data, dummy);
 }
 
-void Radio::receive(uint8_t* data, uint8_t& length) {
-  while (fifo_rx.size() == 0);
-  
-  length = fifo_rx.get();
-  
-  for(int i = 0; i < length; ++i) {
-    while (fifo_rx.size() == 0);
-    data[i] = fifo_rx.get();
+void RadioBase::receive(uint8_t* data, uint8_t& length) {
+  const uint8_t* frame;
+  while ((frame = peek(length)) == nullptr) {
+    yield();
+  }
+
+  memcpy(data, frame, length);
+  release();
+}
+
+void RadioBase::receive(uint8_t* data, uint8_t& length, FrameInfo& info) {
+  const uint8_t* frame;
+  while ((frame = peek(length, info)) == nullptr) {
+    yield();
+  }
+
+  memcpy(data, frame, length);
+  release();
+}
+
+bool RadioBase::receive(uint8_t* data, uint8_t& length, uint32_t timeout_ms) {
+  uint32_t start = millis();
+  while (!try_receive(data, length)) {
+    if (millis() - start >= timeout_ms) {
+      return false;
+    }
+    yield();
+  }
+  return true;
+}
+
+bool RadioBase::receive(uint8_t* data, uint8_t& length, FrameInfo& info, uint32_t timeout_ms) {
+  uint32_t start = millis();
+  while (!try_receive(data, length, info)) {
+    if (millis() - start >= timeout_ms) {
+      return false;
+    }
+    yield();
+  }
+  return true;
+}
+
+bool RadioBase::try_receive(uint8_t* data, uint8_t& length) {
+  auto frame = peek(length);
+  if (!frame) {
+    return false;
+  }
+  memcpy(data, frame, length);
+  release();
+  return true;
+}
+
+bool RadioBase::try_receive(uint8_t* data, uint8_t& length, FrameInfo& info) {
+  auto frame = peek(length, info);
+  if (!frame) {
+    return false;
+  }
+  memcpy(data, frame, length);
+  release();
+  return true;
+}
+
+// Oldest frame of fifo_rx, the header before it is taken out to rx_frame_status first (main loop only).
+const uint8_t* RadioBase::peek_frame(uint8_t& length) {
+  auto frame = fifo_rx.peek(length);
+  if (frame && rx_records_left == 0) {
+    memcpy(&rx_frame_status, frame, sizeof(RxStatus));
+    rx_records_left = rx_frame_status.records_size;
+    fifo_rx.skip();
+    frame = fifo_rx.peek(length);
   }
+  return frame;
+}
+
+const uint8_t* RadioBase::peek(uint8_t& length) {
+  print_debug_log();
+  return peek_frame(length);
+}
+
+// below the noise floor the packet is weaker than the power in the band
+static int packet_rssi(uint8_t rssi, uint8_t snr) {
+  int8_t snr_x4 = static_cast<int8_t>(snr);
+  return -164 + rssi + (snr_x4 < 0 ? snr_x4 / 4 : 0);
+}
+
+const uint8_t* RadioBase::peek(uint8_t& length, FrameInfo& info) {
+  auto frame = peek(length);
+  if (!frame) {
+    return nullptr;
+  }
+  const RxStatus& status = rx_frame_status;
+  info.time_us = status.time;
+  info.rssi = packet_rssi(status.rssi, status.snr);
+  info.snr = static_cast<int8_t>(status.snr) / 4.0f;
+  // 20-bit two's complement, in units of 2^24 / 32 MHz * bandwidth / 500 kHz
+  int32_t fei = (static_cast<int32_t>(status.frequency_error[0] & 0x0F) << 16) | (status.frequency_error[1] << 8) | status.frequency_error[2];
+  if (fei & 0x80000) {
+    fei -= 0x100000;
+  }
+  info.frequency_error = static_cast<int32_t>(static_cast<int64_t>(fei) * (1 << 24) / 32 * bandwidth_in_hz(config.bandwidth) / 500000 / 1000000);
+  return frame;
+}
 
-  frames_in_rx_fifo--;
+void RadioBase::release() {
+  uint8_t length;
+  if (peek_frame(length)) {
+    fifo_rx.release();
+    rx_records_left -= length + 1u;
+  }
 }
 
-int Radio::get_rssi_last() {
-  return -164 + read_register(SX1278_REG_PKT_RSSI_VALUE);
+int RadioBase::get_rssi_last() const {
+  return packet_rssi(last_rssi, last_snr);
 }
 
-int Radio::get_rssi_now() {
+int RadioBase::get_rssi_now() {
   return -164 + read_register(SX1278_REG_RSSI_VALUE);
 }
+
+float RadioBase::get_snr_last() const {
+  return static_cast<int8_t>(last_snr) / 4.0f;
+}
+
+RadioBase::Stats RadioBase::stats() {
+  transport->block_interrupt();
+  Stats copy = radio_stats;
+  transport->unblock_interrupt();
+  return copy;
+}
+
+void RadioBase::reset_stats() {
+  transport->block_interrupt();
+  memset(&radio_stats, 0, sizeof(radio_stats));
+  transport->unblock_interrupt();
+}
+
+const RadioBase::Config& RadioBase::get_config() const {
+  return config;
+}
+
+bool RadioBase::set_config(const Config& config_) {
+  if (!valid_config(config_)) {
+    return false;
+  }
+  flush();
+  if (!initialised) {
+    config = config_;
+    return begin();
+  }
+  return retune(config_);
+}
+
+bool RadioBase::retune(const Config& config_) {
+  if (!valid_config(config_)) {
+    return false;
+  }
+  if (config_.implicit_header_length != config.implicit_header_length && (tx_reserved || queued_frames() > 0)) {
+    // frames are padded to (or sent as) their own length, the receiver would expect the new one
+    if (debug_enabled) {
+      SerialUSB.println("[radio] implicit header length changes with frames waiting!");
+    }
+    return false;
+  }
+  if (!initialised) {
+    // written by begin()
+    config = config_;
+    return true;
+  }
+
+  // interrupt blocked (register access below keeps it blocked), so no frame is started meanwhile
+  transport->block_interrupt();
+  // frame on air (or channel activity detection) is finished with old settings, the module returns to standby after it
+  uint8_t op_mode;
+  while (mode == Mode::Transmit &&
+         ((op_mode = read_register(SX1278_REG_OP_MODE) & 0b111) == SX1278_TX || op_mode == SX1278_CAD)) {
+    yield();
+  }
+  bool receiving = mode == Mode::Receive;
+  if (receiving) {
+    set_op_mode(SX1278_STANDBY);
+  }
+
+  config = config_;
+  if (memcmp(config.frequency, &register_shadow[SX1278_REG_FRF_MSB], sizeof(config.frequency)) != 0) {
+    write_register_burst(SX1278_REG_FRF_MSB, config.frequency, sizeof(config.frequency));
+  }
+  update_register(SX1278_REG_MODEM_CONFIG_1, modem_config_1(config));
+  update_register(SX1278_REG_MODEM_CONFIG_2, modem_config_2(config));
+  if (config.implicit_header_length > 0) {
+    update_register(SX1278_REG_PAYLOAD_LENGTH, config.implicit_header_length);
+  }
+  update_register(SX1278_REG_MODEM_CONFIG_3, modem_config_3(config));
+  update_register(SX1278_REG_DETECT_OPTIMIZE, (register_shadow[SX1278_REG_DETECT_OPTIMIZE] & 0b11111000)
+                  | (sf6(config) ? SX1278_DETECT_OPTIMIZE_SF_6 : SX1278_DETECT_OPTIMIZE_SF_7_12));
+  update_register(SX1278_REG_DETECTION_THRESHOLD, sf6(config) ? SX1278_DETECTION_THRESHOLD_SF_6 : SX1278_DETECTION_THRESHOLD_SF_7_12);
+
+  // waiting frames are sent with new settings, queued airtime follows
+  uint32_t queued = 0;
+  for (uint8_t i = 0; i < priorities; ++i) {
+    tx_queues[i]->for_each([&](uint8_t length) {
+      queued += config.time_on_air(length);
+    });
+  }
+  tx_airtime_queued = tx_airtime_started + queued;
+  tdma_airtime_us = config.time_on_air(tdma_airtime_length);
+
+  if (receiving) {
+    set_op_mode(SX1278_RXCONTINUOUS);
+  }
+  transport->unblock_interrupt();
+  return true;
+}
+
+bool RadioBase::set_frequency(float frequency_in_mhz) {
+  return retune(Config(frequency_in_mhz, config.bandwidth, config.spreadingFactor, config.codingRate, config.implicit_header_length));
+}
+
+bool RadioBase::set_modem(Bandwidth bandwidth, SpreadingFactor spreadingFactor, CodingRate codingRate) {
+  Config changed = config;
+  changed.bandwidth = bandwidth;
+  changed.spreadingFactor = spreadingFactor;
+  changed.codingRate = codingRate;
+  return retune(changed);
+}
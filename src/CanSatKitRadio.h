@@ -3,6 +3,9 @@
 
 #include <cstdint>
 
+#include "CanSatKitRadioTransport.h"
+#include "fifo.h"
+
 namespace CanSatKit {
 
 /**
@@ -13,6 +16,8 @@ namespace CanSatKit {
  * Maximum data length is 254 bytes (+1 byte of null termination).
  */
 class Frame : public Print {
+  friend class RadioBase;
+
  public:
   Frame() : size(0) {}
   
@@ -53,7 +58,11 @@ class Frame : public Print {
   }
 };
 
-class Radio {
+/**
+ * @brief Radio logic and state of one SX1278 module, without the buffers.
+ * Use Radio, or BasicRadio to choose the size of the transmit and receive buffers.
+ */
+class RadioBase {
  public:
   enum class Bandwidth {
     _7800_Hz = 0b00000000,
@@ -69,6 +78,7 @@ class Radio {
   };
   
   enum class SpreadingFactor {
+    _6 = 0b01100000,
     _7 = 0b01110000,
     _8 = 0b10000000,
     _9 = 0b10010000,
@@ -83,70 +93,453 @@ class Radio {
     _4_7 = 0b00000110,
     _4_8 = 0b00001000,
   };
+
+  /**
+   * @brief Transmit queue of a frame. Frames of higher priority are sent first,
+   * frames of the same priority in order. Each priority has its own buffer space:
+   * 10 frames of 255 bytes for Normal, 2 for High and Low (see BasicRadio).
+   */
+  enum class Priority {
+    High,
+    Normal,
+    Low,
+  };
+
+  /**
+   * @brief Number of transmit priorities.
+   */
+  static constexpr std::uint8_t priorities = 3;
   
   /**
-   * @brief Construct a new Radio object. 
-   * Settings should be the same on the receiver and transmitter.
-   * Make sure that you comply with CanSat and local regulations.
-   * Settings reflect on bitrate and link budget.
-   * Bitrate = bandwidth/(2**spreadingFactor) * codingRate
+   * @brief Modem settings converted to radio module register values.
+   * Declare it `constexpr` to compute the register values at compile time:
    * 
-   * @param pin_cs_  Arduino pin number connected to radio CS pin. Set to `Pins::Radio::ChipSelect` if you use CanSatKit.
-   * @param pin_dio0_ Arduino pin number connected to radio DIO0 pin. Set to `Pins::Radio::DIO0` if you use CanSatKit.
-   * @param frequency_in_mhz Set radio center frequency.
-   * @param bandwidth Set module radio bandwidth.
-   * @param spreadingFactor Set module spreading factor.
-   * @param codingRate Set module coding rate.
+   *     constexpr Radio::Config config(433.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8);
+   *     Radio radio(Pins::Radio::ChipSelect, Pins::Radio::DIO0, config);
+   * 
+   * With implicit header (fixed frame length) the header is not sent, which saves airtime,
+   * and spreading factor 6 (the fastest) can be used:
+   * 
+   *     constexpr Radio::Config config(433.0, Bandwidth_500000_Hz, SpreadingFactor_6, CodingRate_4_5, 16);
+   */
+  struct Config {
+    Config() = default;
+
+    /**
+     * @brief Construct modem settings, parameters are the same as in Radio constructor.
+     * 
+     * @param implicit_header_length_ length of every frame in implicit header mode
+     * (shorter frames are padded with zeros), `0` for explicit header. Spreading factor 6 requires implicit header.
+     * Both sides of the link have to use the same length.
+     */
+    constexpr Config(float frequency_in_mhz, Bandwidth bandwidth_, SpreadingFactor spreadingFactor_, CodingRate codingRate_,
+                     std::uint8_t implicit_header_length_ = 0)
+      : frequency{frequency_byte(frequency_in_mhz, 16), frequency_byte(frequency_in_mhz, 8), frequency_byte(frequency_in_mhz, 0)},
+        bandwidth(bandwidth_), spreadingFactor(spreadingFactor_), codingRate(codingRate_), implicit_header_length(implicit_header_length_) {}
+
+    /**
+     * @brief Carrier frequency registers (MSB first), frequency / (32 MHz / 2^19).
+     */
+    std::uint8_t frequency[3];
+    Bandwidth bandwidth;
+    SpreadingFactor spreadingFactor;
+    CodingRate codingRate;
+    /**
+     * @brief Frame length in implicit header mode, `0` in explicit header mode.
+     */
+    std::uint8_t implicit_header_length;
+
+    /**
+     * @brief Low data rate optimisation is required when symbol time exceeds 16 ms.
+     */
+    constexpr bool low_data_rate_optimize() const {
+      return RadioBase::low_data_rate_optimize(bandwidth, spreadingFactor);
+    }
+
+    /**
+     * @brief Time on air of a frame with these settings, see RadioBase::time_on_air().
+     */
+    constexpr std::uint32_t time_on_air(std::uint8_t length) const {
+      return RadioBase::time_on_air(bandwidth, spreadingFactor, codingRate, length, implicit_header_length != 0);
+    }
+
+   private:
+    static constexpr std::uint8_t frequency_byte(float frequency_in_mhz, int shift) {
+      return (static_cast<std::uint32_t>(frequency_in_mhz * 16384) >> shift) & 0xFF;
+    }
+  };
+
+  /**
+   * @brief Link quality of a received frame, measured by the radio module when the frame was received
+   * (see receive()). Messages of an aggregated frame share it.
+   */
+  struct FrameInfo {
+    /**
+     * @brief micros() at the end of the frame (reception done interrupt).
+     */
+    std::uint32_t time_us;
+    /**
+     * @brief RSSI of the frame in dBm.
+     */
+    int rssi;
+    /**
+     * @brief Signal to noise ratio in dB (0.25 dB steps), negative below the noise floor.
+     */
+    float snr;
+    /**
+     * @brief Frequency offset of the received carrier estimated by the modem, in Hz.
+     */
+    std::int32_t frequency_error;
+  };
+
+  /**
+   * @brief Number of bins of Stats histograms.
+   */
+  static constexpr std::uint8_t histogram_bins = 16;
+
+  /**
+   * @brief Radio counters since start or reset_stats(), see stats().
+   * Histograms have log2 bins of microseconds: bin 0 counts 0 us, bin k counts
+   * 2^(k-1) ... 2^k - 1 us, the last bin counts everything longer.
+   */
+  struct Stats {
+    /**
+     * @brief Frames put on air and their bytes (aggregated messages count as one frame).
+     */
+    std::uint32_t frames_sent;
+    std::uint32_t bytes_sent;
+    /**
+     * @brief Frames received and stored in the receive buffer and their bytes.
+     */
+    std::uint32_t frames_received;
+    std::uint32_t bytes_received;
+    /**
+     * @brief Frames received with CRC error (dropped).
+     */
+    std::uint32_t crc_errors;
+    /**
+     * @brief Frames dropped because the receive buffer was full.
+     */
+    std::uint32_t rx_overflows;
+    /**
+     * @brief Frames refused by transmit() or reserve() because the transmit buffer was full.
+     */
+    std::uint32_t tx_full;
+    /**
+     * @brief Waiting frames removed from the transmit buffer to make space (drop oldest policy).
+     */
+    std::uint32_t tx_dropped;
+    /**
+     * @brief Waiting frames overwritten by a newer frame of the same key, see transmit_latest().
+     */
+    std::uint32_t tx_replaced;
+    /**
+     * @brief Switches between transmit and receive mode.
+     */
+    std::uint32_t mode_switches;
+    /**
+     * @brief Frames delayed by a random backoff because another transmission was detected
+     * on the channel, see enable_listen_before_talk().
+     */
+    std::uint32_t channel_busy;
+    /**
+     * @brief Times the transmission stopped until the next TDMA slot of this node, see set_tdma_slot().
+     */
+    std::uint32_t slot_waits;
+    /**
+     * @brief Most frames waiting in the transmit and receive buffer at once.
+     */
+    std::uint16_t tx_frames_max;
+    std::uint16_t rx_frames_max;
+    /**
+     * @brief Execution time of the radio interrupt.
+     */
+    std::uint32_t interrupt_time[histogram_bins];
+    /**
+     * @brief Time between consecutive frames of a transmission (end of a frame to start of the next one).
+     */
+    std::uint32_t tx_gap[histogram_bins];
+  };
+
+  /**
+   * @brief Time on air of a frame (preamble, header, payload and CRC), following the SX1278 datasheet.
+   * Can be evaluated at compile time, eg. to check the telemetry rate:
+   * 
+   *     static_assert(Radio::time_on_air(Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8, 40) < 500000, "too slow");
+   * 
+   * @param length payload length in bytes
+   * @param implicit_header `true` if the header is not sent (implicit header mode)
+   * @return std::uint32_t time on air in microseconds
    */
-  Radio(int pin_cs_, int pin_dio0_, float frequency_in_mhz, Bandwidth bandwidth, SpreadingFactor spreadingFactor, CodingRate codingRate);
+  static constexpr std::uint32_t time_on_air(Bandwidth bandwidth, SpreadingFactor spreadingFactor, CodingRate codingRate, std::uint8_t length,
+                                             bool implicit_header = false) {
+    return ((static_cast<std::uint64_t>(symbols_x4(bandwidth, spreadingFactor, codingRate, length, implicit_header)) * 1000000u << sf_number(spreadingFactor))
+            + 2 * bandwidth_in_hz(bandwidth)) / (4 * bandwidth_in_hz(bandwidth));
+  }
+
+  /**
+   * @brief Low data rate optimisation is required when symbol time exceeds 16 ms
+   * (eg. spreading factor 11 and 12 at 125 kHz). It is set automatically by begin().
+   */
+  static constexpr bool low_data_rate_optimize(Bandwidth bandwidth, SpreadingFactor spreadingFactor) {
+    return (1000000ull << sf_number(spreadingFactor)) > 16000ull * bandwidth_in_hz(bandwidth);
+  }
+
   /**
    * @brief Start communication with radio module.
    * Sets proper radio settings and starts module in receive mode.
    * 
-   * @return `true`: Communication succeeded, module initialised properly. `false`: Module initialisation failed.
+   * @return `true`: Communication succeeded, module initialised properly. `false`: Module initialisation failed
+   * (or spreading factor 6 without implicit header, or SPITransport::max_interrupts radios already running).
    */
-  static bool begin();
+  bool begin();
 
   /**
    * @brief Disable debug messages on SerialUSB.
    */
-  static void disable_debug();
+  void disable_debug();
+
+  /**
+   * @brief Enable debug messages on SerialUSB (enabled by default).
+   * Messages of the radio interrupt are queued and printed later by poll(), available(), peek(),
+   * reserve() and flush(), so printing does not delay the interrupt.
+   */
+  void enable_debug();
+
+  /**
+   * @brief Compare registers written by the library with the radio module (debugging aid).
+   * Masked register writes use a copy of the register kept by the library
+   * instead of reading it from the module first. This checks that the copy is in sync.
+   * Mismatches are printed on SerialUSB if debug is enabled.
+   * 
+   * @return `true` if all known registers match.
+   */
+  bool verify_registers();
   
   /**
    * @brief Put frame into the transmit buffer.
    * @return `true` if frame put into buffer. `false` if not enough space in the buffer.
    */
-  static bool transmit(Frame frame);
+  bool transmit(const Frame& frame, Priority priority = Priority::Normal);
 
   /**
    * @brief Put String str into the transmit buffer.
    * @return `true` if frame put into buffer. `false` if not enough space in the buffer.
    */
-  static bool transmit(String str);
+  bool transmit(String str, Priority priority = Priority::Normal);
 
   /**
    * @brief Put string str into the transmit buffer.
    * @return `true` if frame put into buffer. `false` if not enough space in the buffer.
    */
-  static bool transmit(const char* str);
+  bool transmit(const char* str, Priority priority = Priority::Normal);
 
   /**
    * @brief Put binary data into the transmit buffer (byte table of length length).
    * @return `true` if frame put into buffer. `false` if not enough space in the buffer.
    */
-  static bool transmit(const std::uint8_t* data, std::uint8_t length);
+  bool transmit(const std::uint8_t* data, std::uint8_t length, Priority priority = Priority::Normal);
+
+  /**
+   * @brief Number of keys for transmit_latest().
+   */
+  static constexpr std::uint8_t latest_keys = 8;
+
+  /**
+   * @brief Put binary data into the transmit buffer, replacing the waiting (not yet sent) frame of the same key.
+   * Use it for periodic data where only the newest value matters, eg. one key for each telemetry channel.
+   * The waiting frame is replaced in place (keeping its position in the queue) if it has the same length
+   * and priority, otherwise the new frame is queued as by transmit().
+   *
+   * @param key channel of the frame, `0` ... `latest_keys - 1`
+   * @return `true` if frame replaced the waiting one or was put into buffer. `false` if not enough space in the buffer.
+   */
+  bool transmit_latest(std::uint8_t key, const std::uint8_t* data, std::uint8_t length, Priority priority = Priority::Normal);
+
+  /**
+   * @brief Select what happens when a frame does not fit in the transmit buffer.
+   * By default the new frame is refused (transmit() returns `false`).
+   * With drop oldest, the oldest waiting frames of the same priority are removed to make space for it.
+   *
+   * @param enabled `true` to drop oldest frames, `false` to refuse the new one
+   */
+  void set_drop_oldest(bool enabled);
+
+  /**
+   * @brief Reserve space for a frame directly in the transmit buffer.
+   * Fill the returned memory and pass it to the radio with commit().
+   * Only one frame can be reserved at a time.
+   * 
+   * @param length maximum length of the frame
+   * @param priority transmit queue of the frame
+   * @return std::uint8_t* memory to fill with frame data, `nullptr` if not enough space in the buffer.
+   */
+  std::uint8_t* reserve(std::uint8_t length, Priority priority = Priority::Normal);
+
+  /**
+   * @brief Put the frame prepared with reserve() into the transmit queue.
+   * In implicit header mode the frame is padded with zeros to the configured length.
+   * 
+   * @param length actual length of the frame (not more than reserved), `0` (or more) drops the reservation.
+   * @return `true` if frame was queued.
+   */
+  bool commit(std::uint8_t length);
+
+  /**
+   * @brief Time on air of a frame with the settings of this radio.
+   * 
+   * @param length payload length in bytes
+   * @return std::uint32_t time on air in microseconds
+   */
+  std::uint32_t time_on_air(std::uint8_t length) const;
+
+  /**
+   * @brief Predicted time until all frames in the transmit buffer are sent,
+   * including the rest of the frame being transmitted now.
+   * 
+   * @return std::uint32_t time in microseconds, `0` if nothing is being sent
+   */
+  std::uint32_t tx_queue_time() const;
+
+  /**
+   * @brief Predicted time until a frame of given length put into the transmit buffer now is sent completely.
+   * 
+   * @param length payload length in bytes
+   * @return std::uint32_t time in microseconds
+   */
+  std::uint32_t transmit_delay(std::uint8_t length) const;
+
+  /**
+   * @brief Pack messages into shared radio frames to save airtime of the preamble and header of each frame.
+   * Frames are sent when full or after max_delay_ms from the first message in the frame
+   * (checked by poll() and by the next message).
+   * Received frames are split back into messages, so available() and receive() work as before.
+   * Both sides of the link have to enable aggregation. Maximum message length is 254 bytes.
+   * Not available in implicit header mode (frames of fixed length).
+   * TransmitFrame reserves a whole frame, so messages waiting for aggregation are sent before it.
+   * 
+   * @param max_delay_ms maximum time a message waits for other messages
+   */
+  void enable_aggregation(std::uint16_t max_delay_ms);
+
+  /**
+   * @brief Send the partially filled frame and stop aggregating messages.
+   * Does nothing while a frame is reserved.
+   */
+  void disable_aggregation();
+
+  /**
+   * @brief Listen before talk: check the channel with channel activity detection (CAD) before each frame
+   * and, when another LoRa transmission is detected, listen for a random time before checking again,
+   * eg. when several CanSats share the channel of one ground station.
+   * CAD takes about two symbols and detects signals of the same bandwidth and spreading factor only.
+   * Frames waiting after a busy channel are sent by poll() and flush().
+   * 
+   * @param max_backoff_ms maximum random waiting time after the channel was busy
+   */
+  void enable_listen_before_talk(std::uint16_t max_backoff_ms);
+
+  /**
+   * @brief Send frames without checking the channel, a frame waiting for the end of a backoff is sent right away.
+   */
+  void disable_listen_before_talk();
+
+  /**
+   * @brief Time division (TDMA): frames are sent only within the slot of this node in each period,
+   * a frame is started only if it ends within the slot (a frame longer than the slot at its start).
+   * Nothing is sent until set_tdma_slot() is called, usually by TdmaNode after a beacon of the ground station.
+   * Frames waiting for the slot are sent by poll() and flush(). Beacons are not handled while flush() waits,
+   * so use flush(timeout) on TDMA nodes; before the first slot flush() returns with frames left in the buffer.
+   */
+  void enable_tdma();
+
+  /**
+   * @brief Set the TDMA slot of this node (TDMA is enabled if it was not).
+   * 
+   * @param epoch_us micros() at the start of a period, eg. of the last beacon of the ground station
+   * @param period_us length of the period (all slots) in microseconds
+   * @param slot_start_us start of the slot of this node from the start of the period
+   * @param slot_length_us length of the slot
+   * @return `false` if the slot is not within the period
+   */
+  bool set_tdma_slot(std::uint32_t epoch_us, std::uint32_t period_us, std::uint32_t slot_start_us, std::uint32_t slot_length_us);
+
+  /**
+   * @brief Send frames at any time, frames waiting for the slot are sent right away.
+   */
+  void disable_tdma();
+
+  /**
+   * @brief Maximum length of a frame passed to transmit() or reserve().
+   * 
+   * @return std::uint8_t 255, 254 when aggregation is enabled, frame length in implicit header mode
+   */
+  std::uint8_t max_frame_length() const;
+
+  /**
+   * @brief Send aggregated messages waiting longer than the maximum delay, resume transmission after
+   * a listen before talk backoff or in the TDMA slot, call the registered callbacks and print queued debug messages.
+   * Call it often (eg. in each loop() iteration) when aggregation, listen before talk or TDMA is enabled
+   * or callbacks are registered.
+   */
+  void poll();
 
   /**
    * @brief Waits until all frames in the transmit buffer are transmitted.
+   * With TDMA enabled and no slot set yet (see enable_tdma()) frames can't be sent, it returns right away.
+   */
+  void flush();
+
+  /**
+   * @brief Same as flush(), but waits at most given time.
+   *
+   * @param timeout_ms maximum waiting time in milliseconds
+   * @return `true` if all frames were transmitted, `false` on timeout (or TDMA without a slot)
+   */
+  bool flush(std::uint32_t timeout_ms);
+
+  /**
+   * @brief Function called by poll() for each received frame.
+   * Frame data is valid only during the call.
    */
-  static void flush();
+  typedef void (*ReceiveCallback)(const std::uint8_t* data, std::uint8_t length, const FrameInfo& info);
+
+  /**
+   * @brief Function called by poll() when the last frame of the transmit buffer was sent.
+   */
+  typedef void (*TransmitCallback)();
+
+  /**
+   * @brief Register function called by poll() for each received frame.
+   * Frames passed to the callback are removed from the receive buffer.
+   *
+   * @param callback function to call, `nullptr` to leave frames in the receive buffer
+   */
+  void on_receive(ReceiveCallback callback);
+
+  /**
+   * @brief Register function called by poll() after transmit buffer has been sent and the module
+   * switched back to receive mode.
+   *
+   * @param callback function to call, `nullptr` to disable
+   */
+  void on_transmit_done(TransmitCallback callback);
   
   /**
    * @brief Checks if transmit fifo is empty, which means that radio module is sending last frame or is idle.
    *
    * @return `true` if transmit fifo is empty
    */
-  static bool tx_fifo_empty();
+  bool tx_fifo_empty() const;
+
+  /**
+   * @brief Let lower priorities through when higher ones keep their queues busy.
+   * A queue that waited while given number of frames of higher priority were sent
+   * gets the next transmission.
+   *
+   * @param frames number of frames, `0` (default) to always send higher priority first
+   */
+  void set_priority_aging(std::uint8_t frames);
 
 
   /**
@@ -154,13 +547,13 @@ class Radio {
    * 
    * @return std::uint8_t Number of received frames.
    */
-  static std::uint8_t available();
+  std::uint8_t available();
 
   /**
    * @brief Get character string from receive buffer
    * @param data pointer to fill with data
    */
-  static void receive(char* data);
+  void receive(char* data);
 
   /**
    * @brief Get binary data from receive buffer
@@ -168,45 +561,585 @@ class Radio {
    * @param data pointer to fill with data
    * @param length length of received frame
    */
-  static void receive(std::uint8_t* data, std::uint8_t& length);
+  void receive(std::uint8_t* data, std::uint8_t& length);
 
   /**
-   * @brief Get the RSSI of last frame.
+   * @brief Get binary data from receive buffer with link quality of the frame.
+   * 
+   * @param data pointer to fill with data
+   * @param length length of received frame
+   * @param info RSSI, SNR, frequency error and time of the frame
+   */
+  void receive(std::uint8_t* data, std::uint8_t& length, FrameInfo& info);
+
+  /**
+   * @brief Same as receive(), but waits at most given time.
+   *
+   * @param data pointer to fill with data
+   * @param length length of received frame
+   * @param timeout_ms maximum waiting time in milliseconds, 0 to return immediately
+   * @return `true` if a frame was received, `false` on timeout
+   */
+  bool receive(std::uint8_t* data, std::uint8_t& length, std::uint32_t timeout_ms);
+
+  /**
+   * @brief Same as receive(), but waits at most given time.
+   *
+   * @param data pointer to fill with data
+   * @param length length of received frame
+   * @param info RSSI, SNR, frequency error and time of the frame
+   * @param timeout_ms maximum waiting time in milliseconds, 0 to return immediately
+   * @return `true` if a frame was received, `false` on timeout
+   */
+  bool receive(std::uint8_t* data, std::uint8_t& length, FrameInfo& info, std::uint32_t timeout_ms);
+
+  /**
+   * @brief Get binary data from receive buffer if there is a frame, never waits.
+   *
+   * @param data pointer to fill with data
+   * @param length length of received frame
+   * @return `true` if a frame was received
+   */
+  bool try_receive(std::uint8_t* data, std::uint8_t& length);
+
+  /**
+   * @brief Same as try_receive(), also gets link quality of the frame.
+   *
+   * @param data pointer to fill with data
+   * @param length length of received frame
+   * @param info RSSI, SNR, frequency error and time of the frame
+   * @return `true` if a frame was received
+   */
+  bool try_receive(std::uint8_t* data, std::uint8_t& length, FrameInfo& info);
+
+  /**
+   * @brief Get the oldest frame from receive buffer without copying it.
+   * Frame stays in the buffer (and the pointer stays valid) until release() is called.
+   * 
+   * @param length length of the frame
+   * @return const std::uint8_t* pointer to frame data, `nullptr` if receive buffer is empty
+   */
+  const std::uint8_t* peek(std::uint8_t& length);
+
+  /**
+   * @brief Same as peek(), also gets link quality of the frame.
+   * 
+   * @param length length of the frame
+   * @param info RSSI, SNR, frequency error and time of the frame
+   * @return const std::uint8_t* pointer to frame data, `nullptr` if receive buffer is empty
+   */
+  const std::uint8_t* peek(std::uint8_t& length, FrameInfo& info);
+
+  /**
+   * @brief Remove the frame returned by peek() from receive buffer.
+   */
+  void release();
+
+  /**
+   * @brief Get the RSSI of the last frame received by the module
+   * (frames in the receive buffer may be older, see receive() with FrameInfo).
    * 
    * @return int RSSI in dBm
    */
-  static int get_rssi_last();
+  int get_rssi_last() const;
 
   /**
    * @brief Get the actual RSSI value.
    * 
    * @return int RSSI in dBm
    */
-  static int get_rssi_now();
+  int get_rssi_now();
+
+  /**
+   * @brief Get the signal to noise ratio of the last frame received by the module.
+   * LoRa frames are received even below the noise floor, down to demodulation_snr().
+   * 
+   * @return float SNR in dB (0.25 dB steps)
+   */
+  float get_snr_last() const;
+
+  /**
+   * @brief Get current modem settings.
+   */
+  const Config& get_config() const;
+
+  /**
+   * @brief Change modem settings (eg. spreading factor) while running.
+   * Waits until the transmit buffer is sent (see flush()), then changes the settings as retune()
+   * (or initialises the module with begin() if it was not initialised yet).
+   * Received frames stay in the receive buffer.
+   * 
+   * @return `true` if new settings were applied, `false` if begin() failed
+   * or settings are not valid (see retune()).
+   */
+  bool set_config(const Config& config);
+
+  /**
+   * @brief Change modem settings right away, frames waiting in the transmit buffer are sent with new settings.
+   * Only registers that differ are written (a few SPI transactions, no re-initialisation like begin()),
+   * eg. to switch link profiles or channels in flight. The frame on air is finished first,
+   * a frame being received is lost.
+   * 
+   * @return `true` if new settings were applied, `false` if they are not valid
+   * (spreading factor 6 without implicit header, implicit header with aggregation enabled)
+   * or implicit header length changes while a frame is reserved or waiting in the transmit buffer.
+   */
+  bool retune(const Config& config);
+
+  /**
+   * @brief Change carrier frequency right away, see retune().
+   */
+  bool set_frequency(float frequency_in_mhz);
+
+  /**
+   * @brief Change bandwidth, spreading factor and coding rate right away, see retune().
+   */
+  bool set_modem(Bandwidth bandwidth, SpreadingFactor spreadingFactor, CodingRate codingRate);
+
+  /**
+   * @brief Get a consistent copy of radio counters (interrupt is blocked while copying).
+   * Counting is cheap and always enabled.
+   */
+  Stats stats();
+
+  /**
+   * @brief Set all radio counters to zero.
+   */
+  void reset_stats();
+
+  /**
+   * @brief Minimum SNR of a frame the module can still receive, from the SX1278 datasheet
+   * (-5 dB at spreading factor 6 down to -20 dB at spreading factor 12).
+   * 
+   * @return float SNR in dB
+   */
+  static constexpr float demodulation_snr(SpreadingFactor spreadingFactor) {
+    return 10.0f - 2.5f * sf_number(spreadingFactor);
+  }
+
+  /**
+   * @brief Bandwidth in Hz.
+   */
+  static constexpr std::uint32_t bandwidth_in_hz(Bandwidth bandwidth) {
+    return bandwidth == Bandwidth::_7800_Hz ? 7800 :
+           bandwidth == Bandwidth::_10400_Hz ? 10400 :
+           bandwidth == Bandwidth::_15600_Hz ? 15600 :
+           bandwidth == Bandwidth::_20800_Hz ? 20800 :
+           bandwidth == Bandwidth::_31250_Hz ? 31250 :
+           bandwidth == Bandwidth::_41700_Hz ? 41700 :
+           bandwidth == Bandwidth::_62500_Hz ? 62500 :
+           bandwidth == Bandwidth::_125000_Hz ? 125000 :
+           bandwidth == Bandwidth::_250000_Hz ? 250000 : 500000;
+  }
+
+ private:
+  // same as preamble registers written by begin()
+  static constexpr std::uint16_t preamble_length = 8;
+
+  static constexpr int sf_number(SpreadingFactor spreadingFactor) {
+    return static_cast<int>(spreadingFactor) >> 4;
+  }
+
+  static constexpr int cr_denominator(CodingRate codingRate) {
+    return (static_cast<int>(codingRate) >> 1) + 4;
+  }
+
+  // payload bits (with header and CRC) beyond the 8 symbols sent at the lowest rate
+  static constexpr int payload_bits(SpreadingFactor spreadingFactor, std::uint8_t length, bool implicit_header) {
+    return 8 * length - 4 * sf_number(spreadingFactor) + 28 + 16 - 20 * implicit_header;
+  }
+
+  static constexpr int payload_symbols(Bandwidth bandwidth, SpreadingFactor spreadingFactor, CodingRate codingRate, std::uint8_t length, bool implicit_header) {
+    return 8 + (payload_bits(spreadingFactor, length, implicit_header) <= 0 ? 0 :
+      (payload_bits(spreadingFactor, length, implicit_header) + payload_bits_per_block(bandwidth, spreadingFactor) - 1)
+        / payload_bits_per_block(bandwidth, spreadingFactor) * cr_denominator(codingRate));
+  }
+
+  static constexpr int payload_bits_per_block(Bandwidth bandwidth, SpreadingFactor spreadingFactor) {
+    return 4 * (sf_number(spreadingFactor) - 2 * low_data_rate_optimize(bandwidth, spreadingFactor));
+  }
+
+  // preamble + 4.25 sync symbols + payload, in quarters of a symbol
+  static constexpr std::uint32_t symbols_x4(Bandwidth bandwidth, SpreadingFactor spreadingFactor, CodingRate codingRate, std::uint8_t length, bool implicit_header) {
+    return 4 * preamble_length + 17 + 4 * payload_symbols(bandwidth, spreadingFactor, codingRate, length, implicit_header);
+  }
+
+ protected:
+  // Link status of each frame received over the air (raw registers, converted to FrameInfo by the main loop),
+  // kept in the receive buffer as a header record before the frame, so each frame that fits has its status.
+  // Messages of an aggregated frame share one header.
+  struct RxStatus {
+    std::uint32_t time;
+    std::uint8_t snr;
+    std::uint8_t rssi;
+    std::uint8_t frequency_error[3];
+    // size of the [length][payload] records after the header
+    std::uint16_t records_size;
+  };
+  static constexpr std::uint8_t rx_header_size = 1 + sizeof(RxStatus);
+
+  // Buffers owned by BasicRadio, transmit queues indexed by Priority.
+  struct Buffers {
+    FrameFIFOBase* tx[priorities];
+    FrameFIFOBase* rx;
+  };
+
+  RadioBase(int pin_cs_, int pin_dio0_, const Config& config_, const Buffers& buffers);
+  RadioBase(RadioTransport& transport_, const Config& config_, const Buffers& buffers);
+  RadioBase(const RadioBase&) = delete;
+  RadioBase& operator=(const RadioBase&) = delete;
+
+  template<std::uint8_t, std::uint8_t>
+  friend class RadioBuffers;
+
+ private:
+  enum class Mode {
+    Transmit,
+    Receive,
+  };
+
+  struct DebugRecord {
+    std::uint32_t time;
+    std::uint8_t event;
+    // length of the frame the message is about, 0 if none
+    std::uint8_t length;
+  };
+
+  // Newest frame of each key of transmit_latest(): payload in the transmit buffer
+  // (aggregated message in a container), valid until the frame it belongs to is sent.
+  struct LatestFrame {
+    std::uint8_t* data;
+    std::uint8_t length;
+    std::uint8_t priority;
+    // tx_committed of its queue when reserved (a container is committed as one frame)
+    std::uint32_t frame;
+  };
+
+  // registers up to REG_PLL
+  static constexpr std::uint8_t shadow_size = 0x71;
+
+  static void interrupt(void* radio);
+  void radio_interrupt();
+  void receive_frame();
+  void count_received(std::uint8_t length);
+  void set_mode(Mode mode_);
+  void set_op_mode(std::uint8_t op_mode);
+  void clear_irq_flags();
+  void start_cad();
+  void back_off();
+  void update_tdma_slot();
+  bool fits_tdma_slot(std::uint8_t length);
+  void wait_for_slot();
+  void resume_transmission();
+  bool tx_in_progress() const;
+  std::int8_t next_queue() const;
+  std::uint8_t next_frame_length();
+  const std::uint8_t* next_frame(std::uint8_t& length, std::uint8_t& priority);
+  const std::uint8_t* peek_frame(std::uint8_t& length);
+  void queue_frame(std::uint8_t priority, std::uint8_t length);
+  void close_container();
+  bool drop_oldest_frame(std::uint8_t priority);
+  std::uint8_t* reserve_frame(std::uint8_t priority, std::uint8_t length);
+  void tx_commit(std::uint8_t priority, std::uint8_t length);
+  void tx_release(std::uint8_t priority);
+  std::uint16_t queued_frames() const;
+
+  std::uint8_t read_register(std::uint8_t reg);
+  void write_register(std::uint8_t reg, std::uint8_t data);
+  void write_register(std::uint8_t reg, std::uint8_t value, std::uint8_t msb, std::uint8_t lsb);
+  void update_register(std::uint8_t reg, std::uint8_t value);
+  void read_register_burst(std::uint8_t reg, std::uint8_t* data, std::uint8_t length);
+  void write_register_burst(std::uint8_t reg, const std::uint8_t* data, std::uint8_t length);
+  static bool shadow_cacheable(std::uint8_t reg);
+  bool shadow_valid(std::uint8_t reg) const;
+  void shadow_update(std::uint8_t reg, std::uint8_t value);
+
+  bool valid_config(const Config& config_);
+  void log_debug(std::uint8_t event, std::uint8_t length = 0);
+  void print_debug_log();
+
+  SPITransport spi_transport;
+  RadioTransport* transport;
+  Config config;
+  // begin() succeeded
+  bool initialised = false;
+  bool debug_enabled = true;
+
+  FrameFIFOBase* const tx_queues[priorities];
+  FrameFIFOBase& fifo_rx;
+  // header of the oldest frame in fifo_rx and bytes of its records not released yet,
+  // 0 if the header is not taken out yet (main loop only)
+  RxStatus rx_frame_status = {};
+  std::uint16_t rx_records_left = 0;
+  // last frame received by the module
+  volatile std::uint8_t last_snr = 0;
+  volatile std::uint8_t last_rssi = 0;
+
+  // Debug messages of the interrupt (and of the main loop with interrupt blocked) are queued
+  // as binary records and printed from the main loop by print_debug_log(),
+  // so debug output does not change the interrupt timing.
+  FIFO<DebugRecord, 32> debug_log;
+  // records that did not fit (producer) and ones already reported (consumer)
+  volatile std::uint16_t debug_log_lost = 0;
+  std::uint16_t debug_log_lost_reported = 0;
+
+  // Shadow copy of the registers written by the library, so masked writes
+  // don't need to read the register first. Registers the chip changes by itself
+  // (FIFO, IRQ flags) are never cached.
+  std::uint8_t register_shadow[shadow_size];
+  std::uint8_t register_shadow_valid[(shadow_size + 7) / 8] = {};
+
+  volatile Mode mode = Mode::Receive;
+
+  // Counters are written by one side only (interrupt, or main loop with interrupt blocked),
+  // stats() copies them with interrupt blocked.
+  Stats radio_stats = {};
+  // a frame was started in this transmission, next one measures the gap
+  bool tx_previous_frame = false;
+
+  // times the transmit buffer was sent (interrupt) and handled by poll() (main loop)
+  volatile std::uint16_t tx_drained = 0;
+  std::uint16_t tx_drained_handled = 0;
+
+  ReceiveCallback receive_callback = nullptr;
+  TransmitCallback transmit_callback = nullptr;
+
+  bool tx_reserved = false;
+  // frame reserved without aggregation
+  std::uint8_t* tx_reserved_frame = nullptr;
+  std::uint8_t tx_reserved_length = 0;
+  std::uint8_t tx_reserved_priority = 0;
+
+  // drop oldest waiting frames when the transmit buffer is full
+  bool tx_drop_oldest = false;
+
+  LatestFrame latest[latest_keys] = {};
+
+  // Aging: a queue waiting while this many frames of higher priority were sent goes next, 0 - off.
+  std::uint8_t priority_aging = 0;
+  // frames of higher priority sent since the oldest frame of each queue is waiting (interrupt only)
+  std::uint8_t tx_waited[priorities] = {};
+
+  // Frames ever committed (main loop) and released (interrupt, or main loop with interrupt blocked)
+  // to each queue, used to tell if a frame is still waiting. Both wrap around.
+  std::uint32_t tx_committed[priorities] = {};
+  volatile std::uint32_t tx_released[priorities] = {};
+
+  // Airtime of all frames ever queued (main loop) and ever started (interrupt), the difference is queued airtime.
+  // Both counters wrap around, only the difference is used.
+  volatile std::uint32_t tx_airtime_queued = 0;
+  volatile std::uint32_t tx_airtime_started = 0;
+  // micros() at the end of the frame being transmitted
+  volatile std::uint32_t tx_end_time = 0;
+
+  // Aggregation: messages are packed as [length][data] records into one open
+  // transmit frame (container), sent when full or max_delay after the first message.
+  // Received frames are split into the records.
+  bool aggregation = false;
+  std::uint32_t aggregation_max_delay_us = 0;
+  std::uint8_t* container = nullptr;
+  std::uint8_t container_used = 0;
+  std::uint8_t container_priority = 0;
+  std::uint32_t container_first_message_time = 0;
+
+  // A busy channel or the end of the TDMA slot switches to Receive until tx_resume_time
+  // (interrupt), then poll() switches back (main loop).
+  volatile bool tx_waiting = false;
+  volatile std::uint32_t tx_resume_time = 0;
+
+  // Listen before talk: CAD runs before each frame (mode stays Transmit).
+  bool listen_before_talk = false;
+  std::uint32_t lbt_max_backoff_us = 0;
+  volatile bool cad_running = false;
+  // backoff random generator state (interrupt only)
+  std::uint32_t lbt_random = 0;
+
+  // TDMA: frames start only if they end within [slot_start, slot_start + slot_length)
+  // of the period beginning at tdma_epoch (written with interrupt blocked).
+  bool tdma = false;
+  bool tdma_synchronised = false;
+  std::uint32_t tdma_epoch = 0;
+  std::uint32_t tdma_period_us = 0;
+  std::uint32_t tdma_slot_start_us = 0;
+  std::uint32_t tdma_slot_length_us = 0;
+  // micros() at the start of the slot the module is in or of the next one
+  std::uint32_t tdma_slot_begin = 0;
+  // time on air of the last frame checked against the slot, follows the modem settings
+  std::uint8_t tdma_airtime_length = 0;
+  std::uint32_t tdma_airtime_us = 0;
+};
+
+// Buffers of BasicRadio, a base class so that they are constructed before RadioBase.
+template<std::uint8_t tx_frames, std::uint8_t rx_frames>
+class RadioBuffers {
+ protected:
+  // up to 255 bytes can be lost at the wrap, transmit queues of High and Low priority hold 2 frames each
+  static constexpr std::uint16_t tx_lane_size = tx_frames ? 2 * 256 + 255 : 0;
+
+  FrameFIFO<tx_frames ? tx_frames * 256 + 255 : 0> fifo_tx;
+  FrameFIFO<tx_lane_size> fifo_tx_high, fifo_tx_low;
+  // received frame of 255 bytes with its header, up to one less can be lost at the wrap
+  static constexpr std::uint16_t rx_record_size = RadioBase::rx_header_size + 256;
+  FrameFIFO<rx_frames ? rx_frames * rx_record_size + rx_record_size - 1 : 0> fifo_rx;
+
+  RadioBase::Buffers buffers() {
+    return RadioBase::Buffers{{&fifo_tx_high, &fifo_tx, &fifo_tx_low}, &fifo_rx};
+  }
 };
 
-constexpr static auto Bandwidth_7800_Hz = Radio::Bandwidth::_7800_Hz;
-constexpr static auto Bandwidth_10400_Hz = Radio::Bandwidth::_10400_Hz;
-constexpr static auto Bandwidth_15600_Hz = Radio::Bandwidth::_15600_Hz;
-constexpr static auto Bandwidth_20800_Hz = Radio::Bandwidth::_20800_Hz;
-constexpr static auto Bandwidth_31250_Hz = Radio::Bandwidth::_31250_Hz;
-constexpr static auto Bandwidth_41700_Hz = Radio::Bandwidth::_41700_Hz;
-constexpr static auto Bandwidth_62500_Hz = Radio::Bandwidth::_62500_Hz;
-constexpr static auto Bandwidth_125000_Hz = Radio::Bandwidth::_125000_Hz;
-constexpr static auto Bandwidth_250000_Hz = Radio::Bandwidth::_250000_Hz;
-constexpr static auto Bandwidth_500000_Hz = Radio::Bandwidth::_500000_Hz;
-
-constexpr static auto SpreadingFactor_7 = Radio::SpreadingFactor::_7;
-constexpr static auto SpreadingFactor_8 = Radio::SpreadingFactor::_8;
-constexpr static auto SpreadingFactor_9 = Radio::SpreadingFactor::_9;
-constexpr static auto SpreadingFactor_10 = Radio::SpreadingFactor::_10;
-constexpr static auto SpreadingFactor_11 = Radio::SpreadingFactor::_11;
-constexpr static auto SpreadingFactor_12 = Radio::SpreadingFactor::_12;
-
-constexpr static auto CodingRate_4_5 = Radio::CodingRate::_4_5;
-constexpr static auto CodingRate_4_6 = Radio::CodingRate::_4_6;
-constexpr static auto CodingRate_4_7 = Radio::CodingRate::_4_7;
-constexpr static auto CodingRate_4_8 = Radio::CodingRate::_4_8;
+/**
+ * @brief Radio with transmit and receive buffers of given size, all state is kept in the object,
+ * so several radio modules can be used at once (eg. a ground station receiving on two channels).
+ * Size the buffers for the direction the node actually uses, eg. a sender-only node:
+ *
+ *     BasicRadio<10, 0> radio(Pins::Radio::ChipSelect, Pins::Radio::DIO0, config);
+ *
+ * saves the receive buffer (about 3 kB of RAM). With no transmit buffer transmit() always returns `false`,
+ * with no receive buffer received frames are dropped (counted as Stats::rx_overflows).
+ *
+ * @tparam tx_frames Frames of 255 bytes in the transmit buffer of Priority::Normal (more shorter frames fit),
+ * `0` for a receive-only radio. High and Low priority get 2 frames each.
+ * @tparam rx_frames Frames of 255 bytes in the receive buffer (more shorter frames fit), `0` for a transmit-only radio.
+ */
+template<std::uint8_t tx_frames, std::uint8_t rx_frames>
+class BasicRadio : private RadioBuffers<tx_frames, rx_frames>, public RadioBase {
+ public:
+  /**
+   * @brief Construct a new Radio object. 
+   * Settings should be the same on the receiver and transmitter.
+   * Make sure that you comply with CanSat and local regulations.
+   * Settings reflect on bitrate and link budget.
+   * Bitrate = bandwidth/(2**spreadingFactor) * codingRate, see time_on_air() for the exact frame duration.
+   * 
+   * @param pin_cs_  Arduino pin number connected to radio CS pin. Set to `Pins::Radio::ChipSelect` if you use CanSatKit.
+   * @param pin_dio0_ Arduino pin number connected to radio DIO0 pin. Set to `Pins::Radio::DIO0` if you use CanSatKit.
+   * @param frequency_in_mhz Set radio center frequency.
+   * @param bandwidth Set module radio bandwidth.
+   * @param spreadingFactor Set module spreading factor (6 requires implicit header, see Config).
+   * @param codingRate Set module coding rate.
+   */
+  BasicRadio(int pin_cs_, int pin_dio0_, float frequency_in_mhz, Bandwidth bandwidth, SpreadingFactor spreadingFactor, CodingRate codingRate)
+    : BasicRadio(pin_cs_, pin_dio0_, Config(frequency_in_mhz, bandwidth, spreadingFactor, codingRate)) {}
+
+  /**
+   * @brief Construct a new Radio object with modem settings prepared as Config
+   * (use `constexpr` Config to skip computation of register values at runtime).
+   * 
+   * @param pin_cs_  Arduino pin number connected to radio CS pin. Set to `Pins::Radio::ChipSelect` if you use CanSatKit.
+   * @param pin_dio0_ Arduino pin number connected to radio DIO0 pin. Set to `Pins::Radio::DIO0` if you use CanSatKit.
+   * @param config Modem settings.
+   */
+  BasicRadio(int pin_cs_, int pin_dio0_, const Config& config)
+    : RadioBase(pin_cs_, pin_dio0_, config, this->buffers()) {}
+
+  /**
+   * @brief Construct a new Radio object connected to the module through own transport
+   * (eg. emulated radio module).
+   * 
+   * @param transport Register access and interrupt of the radio module.
+   * @param config Modem settings.
+   */
+  BasicRadio(RadioTransport& transport, const Config& config)
+    : RadioBase(transport, config, this->buffers()) {}
+};
+
+/**
+ * @brief Radio with buffers for 10 frames of 255 bytes in each direction.
+ */
+using Radio = BasicRadio<10, 10>;
+
+/**
+ * @brief TransmitFrame is a Frame built directly in the radio transmit buffer.
+ * Use it the same as Frame, then call send() - the data is not copied again.
+ * Transmit buffer space is reserved for the whole lifetime of the object,
+ * so keep it short-lived (no other frame can be transmitted in the meantime).
+ * Maximum data length is 254 bytes (+1 byte of null termination), 253 bytes with aggregation enabled.
+ *
+ *     TransmitFrame frame(radio);
+ */
+class TransmitFrame : public Print {
+ public:
+  explicit TransmitFrame(RadioBase& radio_, RadioBase::Priority priority = RadioBase::Priority::Normal)
+    : size(0), radio(radio_), max_size(radio.max_frame_length()), buffer(reinterpret_cast<char*>(radio.reserve(max_size, priority))) {}
+  TransmitFrame(const TransmitFrame&) = delete;
+  TransmitFrame& operator=(const TransmitFrame&) = delete;
+
+  ~TransmitFrame() {
+    if (buffer) {
+      radio.commit(0);
+    }
+  }
+
+  /**
+  * @brief actual size of the frame (string length)
+  */
+  std::uint8_t size;
+
+  /**
+   * @brief Checks if space in the transmit buffer was reserved.
+   * 
+   * @return `true` if frame can be filled and sent
+   */
+  bool valid() const {
+    return buffer != nullptr;
+  }
+
+  /**
+   * @brief Queue frame for transmission. Frame cannot be used afterwards.
+   * 
+   * @return `true` if frame put into transmit queue
+   */
+  bool send() {
+    if (!buffer) {
+      return false;
+    }
+    buffer[size] = '\0';
+    buffer = nullptr;
+    return radio.commit(size + 1u);
+  }
+
+ private:
+  RadioBase& radio;
+  std::uint8_t max_size;
+  char* buffer;
+
+  virtual size_t write(uint8_t x) {
+    // one byte for null termination
+    if (!buffer || size >= max_size - 1) {
+      return 0;
+    }
+    buffer[size++] = x;
+    return 1;
+  }
+};
+
+constexpr static auto Bandwidth_7800_Hz = RadioBase::Bandwidth::_7800_Hz;
+constexpr static auto Bandwidth_10400_Hz = RadioBase::Bandwidth::_10400_Hz;
+constexpr static auto Bandwidth_15600_Hz = RadioBase::Bandwidth::_15600_Hz;
+constexpr static auto Bandwidth_20800_Hz = RadioBase::Bandwidth::_20800_Hz;
+constexpr static auto Bandwidth_31250_Hz = RadioBase::Bandwidth::_31250_Hz;
+constexpr static auto Bandwidth_41700_Hz = RadioBase::Bandwidth::_41700_Hz;
+constexpr static auto Bandwidth_62500_Hz = RadioBase::Bandwidth::_62500_Hz;
+constexpr static auto Bandwidth_125000_Hz = RadioBase::Bandwidth::_125000_Hz;
+constexpr static auto Bandwidth_250000_Hz = RadioBase::Bandwidth::_250000_Hz;
+constexpr static auto Bandwidth_500000_Hz = RadioBase::Bandwidth::_500000_Hz;
+
+constexpr static auto SpreadingFactor_6 = RadioBase::SpreadingFactor::_6;
+constexpr static auto SpreadingFactor_7 = RadioBase::SpreadingFactor::_7;
+constexpr static auto SpreadingFactor_8 = RadioBase::SpreadingFactor::_8;
+constexpr static auto SpreadingFactor_9 = RadioBase::SpreadingFactor::_9;
+constexpr static auto SpreadingFactor_10 = RadioBase::SpreadingFactor::_10;
+constexpr static auto SpreadingFactor_11 = RadioBase::SpreadingFactor::_11;
+constexpr static auto SpreadingFactor_12 = RadioBase::SpreadingFactor::_12;
+
+constexpr static auto CodingRate_4_5 = RadioBase::CodingRate::_4_5;
+constexpr static auto CodingRate_4_6 = RadioBase::CodingRate::_4_6;
+constexpr static auto CodingRate_4_7 = RadioBase::CodingRate::_4_7;
+constexpr static auto CodingRate_4_8 = RadioBase::CodingRate::_4_8;
+
+constexpr static auto Priority_High = RadioBase::Priority::High;
+constexpr static auto Priority_Normal = RadioBase::Priority::Normal;
+constexpr static auto Priority_Low = RadioBase::Priority::Low;
 
 
 
@@ -0,0 +1,123 @@
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "CanSatKitRadioTransport.h"
+
+using std::uint8_t;
+using namespace CanSatKit;
+
+
+static constexpr uint8_t SPI_READ = 0b00000000;
+static constexpr uint8_t SPI_WRITE = 0b10000000;
+
+static SPISettings spi_settings(std::uint32_t clock_hz) {
+  return SPISettings(clock_hz, MSBFIRST, SPI_MODE0);
+}
+
+void SPITransport::begin() {
+  pinMode(pin_dio0, INPUT);
+  pinMode(pin_cs, OUTPUT);
+  digitalWrite(pin_cs, HIGH);
+  
+  SPI.begin();
+}
+
+void SPITransport::end() {
+  detach_interrupt();
+  SPI.end();
+}
+
+SPITransport::~SPITransport() {
+  detach_interrupt();
+}
+
+void SPITransport::read(uint8_t reg, uint8_t* data, uint8_t length) {
+  // inside block_interrupt() the transaction is open already, ending it would unmask DIO0
+  bool own_transaction = blocked == 0;
+  if (own_transaction) {
+    SPI.beginTransaction(spi_settings(spi_clock_hz));
+  }
+  digitalWrite(pin_cs, LOW);
+  SPI.transfer(reg | SPI_READ);
+  while(length--) {
+    *data = SPI.transfer(0x00);
+    data++;
+  }
+  if (own_transaction) {
+    SPI.endTransaction();
+  }
+  digitalWrite(pin_cs, HIGH);
+}
+
+void SPITransport::write(uint8_t reg, const uint8_t* data, uint8_t length) {
+  // inside block_interrupt() the transaction is open already, ending it would unmask DIO0
+  bool own_transaction = blocked == 0;
+  if (own_transaction) {
+    SPI.beginTransaction(spi_settings(spi_clock_hz));
+  }
+  digitalWrite(pin_cs, LOW);
+  SPI.transfer(reg | SPI_WRITE);
+  while(length--) {
+    SPI.transfer(*data);
+    data++;
+  }
+  if (own_transaction) {
+    SPI.endTransaction();
+  }
+  digitalWrite(pin_cs, HIGH);
+}
+
+// attachInterrupt() handlers get no argument, so each transport gets its own
+static SPITransport* interrupt_transports[SPITransport::max_interrupts];
+
+template<int index>
+void SPITransport::dio0_interrupt() {
+  auto transport = interrupt_transports[index];
+  transport->handler(transport->handler_context);
+}
+
+bool SPITransport::attach_interrupt(void (*handler_)(void*), void* context) {
+  static void (*const dio0_interrupts[max_interrupts])() = {
+    dio0_interrupt<0>,
+    dio0_interrupt<1>,
+    dio0_interrupt<2>,
+    dio0_interrupt<3>,
+  };
+  int index = 0;
+  while (index < max_interrupts && interrupt_transports[index] && interrupt_transports[index] != this) {
+    index++;
+  }
+  if (index == max_interrupts) {
+    return false;
+  }
+  handler = handler_;
+  handler_context = context;
+  interrupt_transports[index] = this;
+  SPI.usingInterrupt(digitalPinToInterrupt(pin_dio0));
+  attachInterrupt(digitalPinToInterrupt(pin_dio0), dio0_interrupts[index], HIGH);
+  return true;
+}
+
+void SPITransport::detach_interrupt() {
+  for (int index = 0; index < max_interrupts; ++index) {
+    if (interrupt_transports[index] == this) {
+      detachInterrupt(digitalPinToInterrupt(pin_dio0));
+      SPI.notUsingInterrupt(digitalPinToInterrupt(pin_dio0));
+      interrupt_transports[index] = nullptr;
+    }
+  }
+}
+
+// SPI transaction masks the interrupt registered with SPI.usingInterrupt(), it is kept open
+// until the outermost unblock_interrupt()
+void SPITransport::block_interrupt() {
+  if (blocked++ == 0) {
+    SPI.beginTransaction(spi_settings(spi_clock_hz));
+  }
+}
+
+void SPITransport::unblock_interrupt() {
+  if (--blocked == 0) {
+    SPI.endTransaction();
+  }
+}
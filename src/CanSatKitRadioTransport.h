@@ -0,0 +1,106 @@
+#ifndef CANSATKITLIBRARY_RadioTransportH_
+#define CANSATKITLIBRARY_RadioTransportH_
+
+#include <cstdint>
+
+namespace CanSatKit {
+
+/**
+ * @brief Connection between Radio and the SX1278 module: register access and DIO0 interrupt.
+ * SPITransport is used by default. Own implementation can be passed to Radio,
+ * eg. to run the library with an emulated radio module.
+ */
+class RadioTransport {
+ public:
+  /**
+   * @brief Prepare pins and bus.
+   */
+  virtual void begin() = 0;
+
+  /**
+   * @brief Release the bus (module not responding) and detach the interrupt handler.
+   */
+  virtual void end() = 0;
+
+  /**
+   * @brief Read length bytes starting from register reg (one transaction).
+   */
+  virtual void read(std::uint8_t reg, std::uint8_t* data, std::uint8_t length) = 0;
+
+  /**
+   * @brief Write length bytes starting from register reg (one transaction).
+   */
+  virtual void write(std::uint8_t reg, const std::uint8_t* data, std::uint8_t length) = 0;
+
+  /**
+   * @brief Call handler(context) while DIO0 is high.
+   * @return false if the handler can't be attached (no interrupt left).
+   */
+  virtual bool attach_interrupt(void (*handler)(void*), void* context) = 0;
+
+  /**
+   * @brief Stop calling the handler, the interrupt can be attached by another transport.
+   */
+  virtual void detach_interrupt() = 0;
+
+  /**
+   * @brief Hold off DIO0 interrupt handler until unblock_interrupt().
+   *
+   * Calls nest: the handler runs again after as many unblock_interrupt() calls.
+   * read() and write() in between keep it held off.
+   */
+  virtual void block_interrupt() = 0;
+
+  /**
+   * @brief Allow DIO0 interrupt handler to run again.
+   */
+  virtual void unblock_interrupt() = 0;
+
+ protected:
+  ~RadioTransport() = default;
+};
+
+/**
+ * @brief SX1278 connected to Arduino SPI, chip select and DIO0 pins.
+ */
+class SPITransport : public RadioTransport {
+ public:
+  /**
+   * @param pin_cs_  Arduino pin number connected to radio CS pin.
+   * @param pin_dio0_ Arduino pin number connected to radio DIO0 pin.
+   * @param spi_clock_hz_ SPI clock, the SX1278 accepts up to 10 MHz. Frames are uploaded to the module
+   *                      between two transmitted frames, so a faster clock shortens the gap on air.
+   */
+  SPITransport(int pin_cs_, int pin_dio0_, std::uint32_t spi_clock_hz_ = 2000000)
+    : pin_cs(pin_cs_), pin_dio0(pin_dio0_), spi_clock_hz(spi_clock_hz_) {}
+  ~SPITransport();
+
+  virtual void begin();
+  virtual void end();
+  virtual void read(std::uint8_t reg, std::uint8_t* data, std::uint8_t length);
+  virtual void write(std::uint8_t reg, const std::uint8_t* data, std::uint8_t length);
+  virtual bool attach_interrupt(void (*handler)(void*), void* context);
+  virtual void detach_interrupt();
+  virtual void block_interrupt();
+  virtual void unblock_interrupt();
+
+  /**
+   * @brief Number of SPITransport objects with interrupt attached at once (radio modules).
+   */
+  static constexpr int max_interrupts = 4;
+
+ private:
+  int pin_cs, pin_dio0;
+  std::uint32_t spi_clock_hz;
+  // depth of block_interrupt() calls (main loop only, handler can't run while it is > 0)
+  int blocked = 0;
+  void (*handler)(void*) = nullptr;
+  void* handler_context = nullptr;
+
+  template<int index>
+  static void dio0_interrupt();
+};
+
+};  // namespace CanSatKit
+
+#endif  // CANSATKITLIBRARY_RadioTransportH_
@@ -0,0 +1,410 @@
+#ifndef CANSATKITLIBRARY_RELIABLELINK_H_
+#define CANSATKITLIBRARY_RELIABLELINK_H_
+
+#include <cstdint>
+#include <cstring>
+
+#include "CanSatKitRadio.h"
+
+namespace CanSatKit {
+
+/**
+ * @brief Reliable, ordered transfer of frames between two radios (eg. logs and configuration
+ * before launch or after landing), selective-repeat ARQ on top of Radio.
+ *
+ * Up to `window` frames are sent in one burst (one switch of the radio to TX and back to RX),
+ * the last one asks the other side for an answer. The answer (frames of the other side or
+ * a short acknowledgement) carries a bitmap of received frames, so only lost frames are sent again.
+ * If no answer comes within the timeout (estimated from measured round-trip time),
+ * unacknowledged frames are sent again.
+ *
+ *     ReliableLink<> link(radio);
+ *
+ *     void loop() {
+ *       // keep the window full, false if there is no space
+ *       while (next_chunk(data, length) && link.send(data, length)) {
+ *         advance_chunk();
+ *       }
+ *       link.poll();
+ *       while (link.available()) {
+ *         link.receive(data, length);
+ *       }
+ *     }
+ *
+ * Both sides have to use a ReliableLink with the same window. While the link is used,
+ * all received frames go through it (other frames are dropped).
+ * Each side keeps 2 * window frames of data (about 4 kB for window of 8).
+ *
+ * Frame: [0xA0 | flags][sequence number][next expected sequence number][bitmap of frames received after it][data]
+ */
+template<std::uint8_t window = 8, class RadioType = Radio>
+class ReliableLink {
+  static_assert(window == 1 || window == 2 || window == 4 || window == 8, "window has to be 1, 2, 4 or 8 frames");
+
+ public:
+  static constexpr std::uint8_t header_length = 4;
+  static constexpr std::uint8_t max_length = 255 - header_length;
+
+  /**
+   * @brief Construct a new ReliableLink object
+   *
+   * @param radio_ radio used for the link (started with begin())
+   */
+  explicit ReliableLink(RadioType& radio_)
+    : radio(radio_), tx_base(0), tx_next(0), tx_acked(0), tx_sent(0), rx_deliver(0), rx_next(0), rx_present(0),
+      respond(false), waiting(false), poll_outstanding(false), sample_rtt(false), backoff(0),
+      deadline(0), burst_end(0), srtt(0), rttvar(0), retransmitted(0), timeouts(0) {}
+
+  ReliableLink(const ReliableLink&) = delete;
+  ReliableLink& operator=(const ReliableLink&) = delete;
+
+  /**
+   * @brief Put frame into the send window, it is transmitted by poll().
+   *
+   * @return `false` if the window is full (wait for acknowledgements) or length is 0 or above max_length
+   * (251 bytes, 250 with aggregation enabled)
+   */
+  bool send(const std::uint8_t* data, std::uint8_t length) {
+    if (length == 0 || length + header_length > radio.max_frame_length() || in_flight() >= window) {
+      return false;
+    }
+    std::uint8_t slot = tx_next % window;
+    std::memcpy(tx_data[slot], data, length);
+    tx_length[slot] = length;
+    tx_acked &= ~(1u << slot);
+    tx_sent &= ~(1u << slot);
+    tx_next++;
+    return true;
+  }
+
+  /**
+   * @brief Handle received frames, timeouts and send frames when it is this side's turn.
+   * Call it often (eg. in each loop() iteration).
+   */
+  void poll() {
+    std::uint8_t length;
+    const std::uint8_t* frame;
+    while ((frame = radio.peek(length)) != nullptr) {
+      handle(frame, length);
+      radio.release();
+    }
+
+    // burst (or other frames) still being transmitted
+    if (!radio.tx_fifo_empty() || radio.tx_queue_time() > 0) {
+      return;
+    }
+
+    bool timed_out = false;
+    if (waiting) {
+      if (static_cast<std::int32_t>(micros() - deadline) < 0) {
+        return;
+      }
+      waiting = false;
+      if (poll_outstanding) {
+        poll_outstanding = false;
+        timed_out = true;
+        timeouts++;
+        if (backoff < max_backoff) {
+          backoff++;
+        }
+      }
+    }
+
+    if (timed_out) {
+      // frames may have been received, only the answer lost - ask for it before sending them again
+      send_probe();
+    } else if (tx_base != tx_next) {
+      send_burst();
+    } else if (respond) {
+      send_acknowledgement();
+    }
+  }
+
+  /**
+   * @brief Number of received frames ready to be read (in order).
+   */
+  std::uint8_t available() const {
+    return static_cast<std::uint8_t>(rx_next - rx_deliver);
+  }
+
+  /**
+   * @brief Get the next received frame without copying it.
+   * Frame stays valid until release() is called.
+   *
+   * @return const std::uint8_t* frame data, `nullptr` if nothing received
+   */
+  const std::uint8_t* peek(std::uint8_t& length) const {
+    if (available() == 0) {
+      return nullptr;
+    }
+    std::uint8_t slot = rx_deliver % window;
+    length = rx_length[slot];
+    return rx_data[slot];
+  }
+
+  /**
+   * @brief Remove the frame returned by peek(), making space for the next one.
+   */
+  void release() {
+    if (available() > 0) {
+      rx_present &= ~(1u << (rx_deliver % window));
+      rx_deliver++;
+    }
+  }
+
+  /**
+   * @brief Get the next received frame, waits (calling poll()) until a frame is received.
+   *
+   * @param data pointer to fill with data (up to max_length bytes)
+   * @param length length of received frame
+   */
+  void receive(std::uint8_t* data, std::uint8_t& length) {
+    const std::uint8_t* frame;
+    while ((frame = peek(length)) == nullptr) {
+      poll();
+      yield();
+    }
+    std::memcpy(data, frame, length);
+    release();
+  }
+
+  /**
+   * @brief Checks if all sent frames are acknowledged.
+   */
+  bool idle() const {
+    return tx_base == tx_next;
+  }
+
+  /**
+   * @brief Waits (calling poll()) until all sent frames are acknowledged.
+   */
+  void flush() {
+    while (!idle()) {
+      poll();
+      yield();
+    }
+  }
+
+  /**
+   * @brief Smoothed round-trip time (end of a burst to the first frame of the answer).
+   *
+   * @return std::uint32_t time in microseconds, `0` before the first answer
+   */
+  std::uint32_t rtt() const {
+    return srtt;
+  }
+
+  /**
+   * @brief Current answer timeout, after which unacknowledged frames are sent again.
+   *
+   * @return std::uint32_t time in microseconds
+   */
+  std::uint32_t timeout() const {
+    std::uint32_t base = srtt == 0 ? 3 * radio.time_on_air(255) : srtt + (4 * rttvar > min_margin ? 4 * rttvar : min_margin);
+    return base << backoff;
+  }
+
+  /**
+   * @brief Number of frames sent again.
+   */
+  std::uint32_t retransmissions() const {
+    return retransmitted;
+  }
+
+  /**
+   * @brief Number of bursts left without an answer.
+   */
+  std::uint32_t lost_answers() const {
+    return timeouts;
+  }
+
+ private:
+  static constexpr std::uint8_t magic = 0xA0;
+  static constexpr std::uint8_t flag_data = 0x01;
+  static constexpr std::uint8_t flag_poll = 0x02;
+  // clock granularity of the timeout (poll() is called from the main loop)
+  static constexpr std::uint32_t min_margin = 10000;
+  static constexpr std::uint8_t max_backoff = 3;
+
+  std::uint8_t in_flight() const {
+    return static_cast<std::uint8_t>(tx_next - tx_base);
+  }
+
+  void handle(const std::uint8_t* frame, std::uint8_t length) {
+    if (length < header_length || (frame[0] & 0xF0) != magic) {
+      return;
+    }
+    std::uint8_t flags = frame[0] & 0x0F;
+    if (poll_outstanding) {
+      poll_outstanding = false;
+      backoff = 0;
+      if (sample_rtt) {
+        update_rtt(micros() - burst_end);
+      }
+    }
+
+    handle_acknowledgement(frame[2], frame[3]);
+    if (flags & flag_data) {
+      handle_data(frame[1], &frame[header_length], length - header_length);
+    }
+
+    if (flags & flag_poll) {
+      // other side waits for an answer
+      respond = true;
+      waiting = false;
+    } else if (flags & flag_data) {
+      // more frames of the burst are coming
+      waiting = true;
+      deadline = micros() + timeout();
+    } else {
+      waiting = false;
+    }
+  }
+
+  void handle_acknowledgement(std::uint8_t next_expected, std::uint8_t bitmap) {
+    for (std::uint8_t seq = tx_base; seq != tx_next; ++seq) {
+      std::uint8_t before = next_expected - seq;
+      std::uint8_t after = seq - next_expected - 1;
+      if ((before >= 1 && before <= window) || (after < 8 && (bitmap & (1u << after)))) {
+        tx_acked |= 1u << (seq % window);
+      }
+    }
+    while (tx_base != tx_next && (tx_acked & (1u << (tx_base % window)))) {
+      tx_acked &= ~(1u << (tx_base % window));
+      tx_base++;
+    }
+  }
+
+  void handle_data(std::uint8_t seq, const std::uint8_t* data, std::uint8_t length) {
+    // old (already delivered) or beyond the receive window
+    if (static_cast<std::uint8_t>(seq - rx_deliver) >= window) {
+      return;
+    }
+    std::uint8_t slot = seq % window;
+    if (rx_present & (1u << slot)) {
+      return;
+    }
+    std::memcpy(rx_data[slot], data, length);
+    rx_length[slot] = length;
+    rx_present |= 1u << slot;
+    while (static_cast<std::uint8_t>(rx_next - rx_deliver) < window && (rx_present & (1u << (rx_next % window)))) {
+      rx_next++;
+    }
+  }
+
+  void write_header(std::uint8_t* buffer, std::uint8_t flags, std::uint8_t seq) {
+    std::uint8_t bitmap = 0;
+    for (std::uint8_t i = 0; i < 8; ++i) {
+      std::uint8_t ahead = rx_next + 1 + i;
+      if (static_cast<std::uint8_t>(ahead - rx_deliver) < window && (rx_present & (1u << (ahead % window)))) {
+        bitmap |= 1u << i;
+      }
+    }
+    buffer[0] = magic | flags;
+    buffer[1] = seq;
+    buffer[2] = rx_next;
+    buffer[3] = bitmap;
+  }
+
+  // all unacknowledged frames, the last one asks for an answer
+  void send_burst() {
+    std::uint8_t last = tx_base;
+    for (std::uint8_t seq = tx_base; seq != tx_next; ++seq) {
+      if (!(tx_acked & (1u << (seq % window)))) {
+        last = seq;
+      }
+    }
+    for (std::uint8_t seq = tx_base; ; ++seq) {
+      std::uint8_t slot = seq % window;
+      if (!(tx_acked & (1u << slot))) {
+        std::uint8_t* buffer = radio.reserve(tx_length[slot] + header_length);
+        if (!buffer) {
+          break;
+        }
+        write_header(buffer, seq == last ? flag_data | flag_poll : flag_data, seq);
+        std::memcpy(&buffer[header_length], tx_data[slot], tx_length[slot]);
+        radio.commit(tx_length[slot] + header_length);
+        if (tx_sent & (1u << slot)) {
+          retransmitted++;
+        }
+        tx_sent |= 1u << slot;
+      }
+      if (seq == last) {
+        break;
+      }
+    }
+    wait_for_answer(true);
+  }
+
+  // header only, asks for an answer
+  void send_probe() {
+    std::uint8_t* buffer = radio.reserve(header_length);
+    if (!buffer) {
+      return;
+    }
+    write_header(buffer, flag_poll, 0);
+    radio.commit(header_length);
+    // Karn's algorithm: answer after a timeout may be an answer to the previous burst
+    wait_for_answer(false);
+  }
+
+  void wait_for_answer(bool rtt_sample) {
+    respond = false;
+    poll_outstanding = true;
+    sample_rtt = rtt_sample;
+    waiting = true;
+    burst_end = micros() + radio.tx_queue_time();
+    // random part keeps both sides from timing out at the same time again
+    std::uint32_t t = timeout();
+    deadline = burst_end + t + random(t / 4 + 1);
+  }
+
+  void send_acknowledgement() {
+    std::uint8_t* buffer = radio.reserve(header_length);
+    if (!buffer) {
+      return;
+    }
+    write_header(buffer, 0, 0);
+    radio.commit(header_length);
+    respond = false;
+  }
+
+  void update_rtt(std::uint32_t sample) {
+    if (srtt == 0) {
+      srtt = sample > 0 ? sample : 1;
+      rttvar = sample / 2;
+    } else {
+      std::uint32_t difference = sample > srtt ? sample - srtt : srtt - sample;
+      rttvar = rttvar - rttvar / 4 + difference / 4;
+      srtt = srtt - srtt / 8 + sample / 8;
+    }
+  }
+
+  RadioType& radio;
+
+  std::uint8_t tx_data[window][max_length];
+  std::uint8_t tx_length[window];
+  std::uint8_t tx_base, tx_next;
+  // bits per slot
+  std::uint8_t tx_acked;
+  std::uint8_t tx_sent;
+
+  std::uint8_t rx_data[window][max_length];
+  std::uint8_t rx_length[window];
+  std::uint8_t rx_deliver, rx_next;
+  std::uint8_t rx_present;
+
+  bool respond;
+  bool waiting;
+  bool poll_outstanding;
+  bool sample_rtt;
+  std::uint8_t backoff;
+  std::uint32_t deadline, burst_end;
+  std::uint32_t srtt, rttvar;
+  std::uint32_t retransmitted;
+  std::uint32_t timeouts;
+};
+
+};  // namespace CanSatKit
+
+#endif  // CANSATKITLIBRARY_RELIABLELINK_H_
@@ -0,0 +1,261 @@
+#ifndef CANSATKITLIBRARY_TDMA_H_
+#define CANSATKITLIBRARY_TDMA_H_
+
+#include <cstdint>
+
+#include "CanSatKitRadio.h"
+
+namespace CanSatKit {
+
+/**
+ * @brief Part shared by TdmaGround and TdmaNode: beacon frames and slot times.
+ *
+ * A period starts with the beacon of the ground station, followed by slot 0 of the ground station
+ * and one slot for each node (1 ... slot count), all slots of the same length:
+ *
+ *     [beacon][slot 0][slot 1][slot 2]...[slot n]
+ *
+ * A slot holds given number of frames of given length (time on air with current modem settings)
+ * and a guard time for clock drift and interrupt latency.
+ *
+ * Beacon frame: [0xBC][slot count][frames per slot][frame length]
+ * (padded with zeros in implicit header mode). Other frames must not look like it.
+ */
+template<class RadioType>
+class TdmaLink {
+ public:
+  static constexpr std::uint8_t frame_length = 4;
+  static constexpr std::uint32_t guard_us = 2000;
+
+  TdmaLink(const TdmaLink&) = delete;
+  TdmaLink& operator=(const TdmaLink&) = delete;
+
+  /**
+   * @brief Length of one slot in microseconds (0 before the schedule is known).
+   */
+  std::uint32_t slot_length() const {
+    return slot_length_us;
+  }
+
+  /**
+   * @brief Length of the period (beacon and all slots) in microseconds (0 before the schedule is known).
+   */
+  std::uint32_t period() const {
+    return period_us;
+  }
+
+ protected:
+  enum : std::uint8_t {
+    marker = 0xBC,
+  };
+
+  explicit TdmaLink(RadioType& radio_)
+    : radio(radio_), slot_count(0), frames_per_slot(0), max_length(0), beacon_us(0), slot_length_us(0), period_us(0) {}
+
+  // time on air, frames have fixed length in implicit header mode
+  std::uint32_t airtime(std::uint8_t length) const {
+    auto config = radio.get_config();
+    return config.time_on_air(config.implicit_header_length > 0 ? config.implicit_header_length : length);
+  }
+
+  void schedule(std::uint8_t slot_count_, std::uint8_t frames_per_slot_, std::uint8_t max_length_) {
+    slot_count = slot_count_;
+    frames_per_slot = frames_per_slot_;
+    max_length = max_length_;
+    beacon_us = airtime(frame_length);
+    slot_length_us = frames_per_slot * airtime(max_length) + guard_us;
+    period_us = beacon_us + (slot_count + 1u) * slot_length_us;
+  }
+
+  // slot 0 of the ground station starts with the beacon
+  std::uint32_t slot_start(std::uint8_t slot) const {
+    return slot == 0 ? 0 : beacon_us + slot * slot_length_us;
+  }
+
+  std::uint32_t slot_length(std::uint8_t slot) const {
+    return slot == 0 ? beacon_us + slot_length_us : slot_length_us;
+  }
+
+  static bool parse(const std::uint8_t* frame, std::uint8_t length, std::uint8_t& slot_count_,
+                    std::uint8_t& frames_per_slot_, std::uint8_t& max_length_) {
+    if (length < frame_length || frame[0] != marker || frame[2] == 0 || frame[3] == 0) {
+      return false;
+    }
+    for (std::uint8_t i = frame_length; i < length; ++i) {
+      if (frame[i] != 0) {
+        return false;
+      }
+    }
+    slot_count_ = frame[1];
+    frames_per_slot_ = frame[2];
+    max_length_ = frame[3];
+    return true;
+  }
+
+  RadioType& radio;
+  std::uint8_t slot_count;
+  std::uint8_t frames_per_slot;
+  std::uint8_t max_length;
+  std::uint32_t beacon_us;
+  std::uint32_t slot_length_us;
+  std::uint32_t period_us;
+};
+
+/**
+ * @brief Time division, ground station side: sends a beacon at the start of each period,
+ * nodes (TdmaNode) send their frames only in their own slots, so frames of several CanSats
+ * (eg. can, payload and relay) sharing one channel do not collide.
+ *
+ *     TdmaGround<> tdma(radio, 3);
+ *
+ *     void setup() {
+ *       radio.begin();
+ *       tdma.begin();
+ *     }
+ *
+ *     void loop() {
+ *       tdma.poll();
+ *       while (radio.available()) {
+ *         radio.receive(data, length);
+ *       }
+ *     }
+ *
+ * Frames of the ground station are sent in slot 0, right after the beacon.
+ * The beacon carries the schedule, so only the ground station has to be changed for another number of nodes.
+ * Don't use aggregation on the ground station, the beacon has to be sent right away.
+ */
+template<class RadioType = Radio>
+class TdmaGround : public TdmaLink<RadioType> {
+ public:
+  /**
+   * @brief Construct a new TdmaGround object
+   *
+   * @param radio_ radio of the ground station
+   * @param slot_count_ number of nodes (slots 1 ... slot_count_)
+   * @param frames_per_slot_ frames each node can send in its slot
+   * @param max_length_ length of the longest frame (sets the slot length)
+   */
+  TdmaGround(RadioType& radio_, std::uint8_t slot_count_, std::uint8_t frames_per_slot_ = 1, std::uint8_t max_length_ = 255)
+    : TdmaLink<RadioType>(radio_), epoch(0) {
+    this->slot_count = slot_count_;
+    this->frames_per_slot = frames_per_slot_;
+    this->max_length = max_length_;
+  }
+
+  /**
+   * @brief Compute the schedule with current modem settings and send the first beacon. Call it after radio begin()
+   * and after a change of modem settings.
+   */
+  void begin() {
+    this->schedule(this->slot_count, this->frames_per_slot, this->max_length);
+    send_beacon();
+  }
+
+  /**
+   * @brief Send the beacon when the period is over. Call it often (eg. in each loop() iteration),
+   * the next period starts when it is called.
+   */
+  void poll() {
+    if (micros() - epoch >= this->period_us) {
+      send_beacon();
+    }
+  }
+
+ private:
+  void send_beacon() {
+    epoch = micros();
+    const std::uint8_t frame[TdmaLink<RadioType>::frame_length] = {this->marker, this->slot_count, this->frames_per_slot, this->max_length};
+    // goes before other frames waiting for slot 0
+    this->radio.transmit(frame, sizeof(frame), Priority_High);
+    this->radio.set_tdma_slot(epoch, this->period_us, this->slot_start(0), this->slot_length(0));
+  }
+
+  std::uint32_t epoch;
+};
+
+/**
+ * @brief Time division, node side: frames of the radio are sent only in the slot of the node,
+ * timed from the beacons of TdmaGround.
+ *
+ *     TdmaNode<> tdma(radio, 1);
+ *
+ *     void setup() {
+ *       radio.begin();
+ *       tdma.begin();
+ *     }
+ *
+ *     void loop() {
+ *       while (radio.available()) {
+ *         radio.receive(data, length, info);
+ *         if (!tdma.handle(data, length, info)) {
+ *           // other frame from the ground station
+ *         }
+ *       }
+ *       radio.poll();
+ *       radio.transmit(telemetry, telemetry_length);
+ *     }
+ *
+ * Nothing is sent before the first beacon. Frames are queued in the transmit buffer meanwhile,
+ * so size it for the frames produced in a period. Each node needs its own slot.
+ * Use radio flush(timeout) (at most about a period), beacons are not handled while it waits.
+ */
+template<class RadioType = Radio>
+class TdmaNode : public TdmaLink<RadioType> {
+ public:
+  /**
+   * @brief Construct a new TdmaNode object
+   *
+   * @param radio_ radio of the node
+   * @param slot_ slot of the node, 1 ... slot count of the ground station
+   */
+  TdmaNode(RadioType& radio_, std::uint8_t slot_)
+    : TdmaLink<RadioType>(radio_), slot(slot_), synchronised(false) {}
+
+  /**
+   * @brief Hold frames until the first beacon. Call it after radio begin().
+   */
+  void begin() {
+    synchronised = false;
+    this->radio.enable_tdma();
+  }
+
+  /**
+   * @brief Pass every frame received from the ground station with its FrameInfo (time of reception).
+   *
+   * @return `true` if it was a beacon (used by the node), `false` for other frames
+   */
+  bool handle(const std::uint8_t* frame, std::uint8_t length, const typename RadioType::FrameInfo& info) {
+    std::uint8_t slot_count_, frames_per_slot_, max_length_;
+    if (!this->parse(frame, length, slot_count_, frames_per_slot_, max_length_)) {
+      return false;
+    }
+    this->schedule(slot_count_, frames_per_slot_, max_length_);
+    if (slot == 0 || slot > this->slot_count) {
+      // no slot for this node
+      if (synchronised) {
+        synchronised = false;
+        this->radio.enable_tdma();
+      }
+      return true;
+    }
+    // beacon started its time on air before the end of reception
+    std::uint32_t epoch = info.time_us - this->beacon_us;
+    synchronised = this->radio.set_tdma_slot(epoch, this->period_us, this->slot_start(slot), this->slot_length(slot));
+    return true;
+  }
+
+  /**
+   * @brief A beacon with a slot for this node was received, frames are being sent.
+   */
+  bool is_synchronised() const {
+    return synchronised;
+  }
+
+ private:
+  std::uint8_t slot;
+  bool synchronised;
+};
+
+};  // namespace CanSatKit
+
+#endif  // CANSATKITLIBRARY_TDMA_H_
@@ -0,0 +1,412 @@
+#ifndef CANSATKITLIBRARY_TELEMETRY_H_
+#define CANSATKITLIBRARY_TELEMETRY_H_
+
+#include <cstdint>
+
+namespace CanSatKit {
+
+/**
+ * @brief One field of binary telemetry frame.
+ * Sender and receiver use the same table of fields (schema), eg.:
+ *
+ *     constexpr TelemetryField schema[] = {
+ *       TelemetryField::unsigned_int("counter", 16),
+ *       TelemetryField::fixed("temperature", -40.0, 0.01, 14),  // -40.00 ... 123.83 *C
+ *       TelemetryField::fixed("pressure", 300.0, 0.01, 17),     // 300.00 ... 1610.71 hPa
+ *       TelemetryField::flag("parachute"),
+ *     };
+ *
+ * Fields are packed bit by bit, the frame above takes 48 bits (6 bytes).
+ * Keep the schema header-only, so it can be shared with a decoder on PC.
+ */
+struct TelemetryField {
+  enum class Type : std::uint8_t {
+    Flag,
+    UnsignedInt,
+    SignedInt,
+    Fixed,
+    Varint,
+    Zigzag,
+  };
+
+  /**
+   * @brief 1-bit field, any non-zero value is stored as 1.
+   */
+  static constexpr TelemetryField flag(const char* name) {
+    return TelemetryField(name, Type::Flag, 1, 0, 1);
+  }
+
+  /**
+   * @brief Integer 0 ... 2^bits - 1, saturated.
+   */
+  static constexpr TelemetryField unsigned_int(const char* name, std::uint8_t bits) {
+    return TelemetryField(name, Type::UnsignedInt, bits, 0, 1);
+  }
+
+  /**
+   * @brief Integer -2^(bits-1) ... 2^(bits-1) - 1 (two's complement), saturated.
+   */
+  static constexpr TelemetryField signed_int(const char* name, std::uint8_t bits) {
+    return TelemetryField(name, Type::SignedInt, bits, 0, 1);
+  }
+
+  /**
+   * @brief Fixed-point number min ... min + (2^bits - 1) * resolution, rounded to resolution and saturated.
+   */
+  static constexpr TelemetryField fixed(const char* name, double min, double resolution, std::uint8_t bits) {
+    return TelemetryField(name, Type::Fixed, bits, min, resolution);
+  }
+
+  /**
+   * @brief Unsigned 32-bit integer in 7-bit groups, small values take fewer bits (8 bits up to 127).
+   */
+  static constexpr TelemetryField varint(const char* name) {
+    return TelemetryField(name, Type::Varint, 0, 0, 1);
+  }
+
+  /**
+   * @brief Signed 32-bit integer as varint, small absolute values take fewer bits (8 bits for -64 ... 63).
+   */
+  static constexpr TelemetryField zigzag(const char* name) {
+    return TelemetryField(name, Type::Zigzag, 0, 0, 1);
+  }
+
+  const char* name;
+  Type type;
+  std::uint8_t bits;
+  double min;
+  double resolution;
+
+ private:
+  constexpr TelemetryField(const char* name_, Type type_, std::uint8_t bits_, double min_, double resolution_)
+    : name(name_), type(type_), bits(bits_), min(min_), resolution(resolution_) {}
+};
+
+/**
+ * @brief Packs telemetry fields into a byte buffer (eg. to be sent with Radio::transmit(const std::uint8_t*, std::uint8_t)).
+ * Values are written in schema order, one write() per field:
+ *
+ *     std::uint8_t frame[16];
+ *     TelemetryWriter telemetry(schema, frame, sizeof(frame));
+ *     telemetry.write(counter);
+ *     telemetry.write(T);
+ *     telemetry.write(P);
+ *     telemetry.write(parachute_deployed);
+ *     radio.transmit(frame, telemetry.size());
+ */
+class TelemetryWriter {
+ public:
+  /**
+   * @brief Construct a new TelemetryWriter object
+   *
+   * @param schema table of fields
+   * @param buffer memory for the encoded frame
+   * @param capacity size of the buffer in bytes
+   */
+  template<std::uint8_t fields>
+  TelemetryWriter(const TelemetryField (&schema)[fields], std::uint8_t* buffer, std::uint8_t capacity)
+    : TelemetryWriter(schema, fields, buffer, capacity) {}
+
+  TelemetryWriter(const TelemetryField* schema_, std::uint8_t fields_, std::uint8_t* buffer_, std::uint8_t capacity_)
+    : schema(schema_), fields(fields_), field(0), buffer(buffer_), capacity_bits(capacity_ * 8u), position(0), error(false) {}
+
+  /**
+   * @brief Construct a TelemetryWriter without schema, for raw write_bits(), write_varint() and write_zigzag() only.
+   */
+  TelemetryWriter(std::uint8_t* buffer_, std::uint8_t capacity_) : TelemetryWriter(nullptr, 0, buffer_, capacity_) {}
+
+  /**
+   * @brief Encode value of the next field of the schema.
+   *
+   * @return `true` if written, `false` if buffer is full or all fields are already written
+   */
+  bool write(double value) {
+    if (field >= fields || error) {
+      return false;
+    }
+    const TelemetryField& f = schema[field++];
+    switch (f.type) {
+      case TelemetryField::Type::Flag:
+        return write_bits(value != 0, 1);
+      case TelemetryField::Type::UnsignedInt:
+        return write_bits(static_cast<std::uint32_t>(round_saturated(value, 0, max_unsigned(f.bits))), f.bits);
+      case TelemetryField::Type::SignedInt: {
+        double half = static_cast<double>(static_cast<std::uint64_t>(1) << (f.bits - 1));
+        return write_bits(static_cast<std::int32_t>(round_saturated(value, -half, half - 1)), f.bits);
+      }
+      case TelemetryField::Type::Fixed:
+        return write_bits(static_cast<std::uint32_t>(round_saturated((value - f.min) / f.resolution, 0, max_unsigned(f.bits))), f.bits);
+      case TelemetryField::Type::Varint:
+        return write_varint(static_cast<std::uint32_t>(round_saturated(value, 0, 4294967295.0)));
+      case TelemetryField::Type::Zigzag:
+        return write_zigzag(static_cast<std::int32_t>(round_saturated(value, -2147483648.0, 2147483647.0)));
+    }
+    return false;
+  }
+
+  /**
+   * @brief Write raw bits, least significant first (for fields not covered by TelemetryField).
+   *
+   * @return `true` if written, `false` if buffer is full
+   */
+  bool write_bits(std::uint32_t value, std::uint8_t bits) {
+    if (error || position + bits > capacity_bits) {
+      error = true;
+      return false;
+    }
+    while (bits > 0) {
+      std::uint8_t offset = position % 8;
+      std::uint8_t chunk = 8 - offset < bits ? 8 - offset : bits;
+      std::uint8_t& byte = buffer[position / 8];
+      if (offset == 0) {
+        byte = 0;
+      }
+      byte |= (value & ((1u << chunk) - 1)) << offset;
+      value >>= chunk;
+      bits -= chunk;
+      position += chunk;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Write unsigned integer in 7-bit groups (see TelemetryField::varint()).
+   *
+   * @return `true` if written, `false` if buffer is full
+   */
+  bool write_varint(std::uint32_t value) {
+    while (value >= 0x80) {
+      if (!write_bits((value & 0x7F) | 0x80, 8)) {
+        return false;
+      }
+      value >>= 7;
+    }
+    return write_bits(value, 8);
+  }
+
+  /**
+   * @brief Write signed integer as varint (see TelemetryField::zigzag()).
+   *
+   * @return `true` if written, `false` if buffer is full
+   */
+  bool write_zigzag(std::int32_t value) {
+    return write_varint(zigzag(value));
+  }
+
+  /**
+   * @brief Signed integer mapped to unsigned, so that small absolute values are small: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+   */
+  static constexpr std::uint32_t zigzag(std::int32_t value) {
+    return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+  }
+
+  /**
+   * @brief Number of bytes taken by write_varint(value).
+   */
+  static constexpr std::uint8_t varint_size(std::uint32_t value) {
+    return value < (1u << 7) ? 1 : value < (1u << 14) ? 2 : value < (1u << 21) ? 3 : value < (1u << 28) ? 4 : 5;
+  }
+
+  /**
+   * @brief Number of bytes used in the buffer (to be transmitted).
+   */
+  std::uint8_t size() const {
+    return (position + 7) / 8;
+  }
+
+  /**
+   * @brief Checks if all values so far fit into the buffer.
+   */
+  bool ok() const {
+    return !error;
+  }
+
+ private:
+  // NaN gives low
+  static double round_saturated(double value, double low, double high) {
+    value = value >= low ? (value <= high ? value : high) : low;
+    return value < 0 ? -static_cast<double>(static_cast<std::int64_t>(0.5 - value)) : static_cast<double>(static_cast<std::int64_t>(value + 0.5));
+  }
+
+  static double max_unsigned(std::uint8_t bits) {
+    return static_cast<double>((static_cast<std::uint64_t>(1) << bits) - 1);
+  }
+
+  const TelemetryField* schema;
+  std::uint8_t fields, field;
+  std::uint8_t* buffer;
+  std::uint16_t capacity_bits, position;
+  bool error;
+};
+
+/**
+ * @brief Unpacks telemetry frame encoded with TelemetryWriter and the same schema:
+ *
+ *     TelemetryReader telemetry(schema, frame, length);
+ *     double value;
+ *     while (telemetry.read(value)) {
+ *       SerialUSB.print(telemetry.name());
+ *       SerialUSB.print(" = ");
+ *       SerialUSB.println(value);
+ *     }
+ */
+class TelemetryReader {
+ public:
+  /**
+   * @brief Construct a new TelemetryReader object
+   *
+   * @param schema table of fields
+   * @param data encoded frame
+   * @param length length of the frame in bytes
+   */
+  template<std::uint8_t fields>
+  TelemetryReader(const TelemetryField (&schema)[fields], const std::uint8_t* data, std::uint8_t length)
+    : TelemetryReader(schema, fields, data, length) {}
+
+  TelemetryReader(const TelemetryField* schema_, std::uint8_t fields_, const std::uint8_t* data_, std::uint8_t length_)
+    : schema(schema_), fields(fields_), field(0), data(data_), length_bits(length_ * 8u), position(0), error(false) {}
+
+  /**
+   * @brief Construct a TelemetryReader without schema, for raw read_bits(), read_varint() and read_zigzag() only.
+   */
+  TelemetryReader(const std::uint8_t* data_, std::uint8_t length_) : TelemetryReader(nullptr, 0, data_, length_) {}
+
+  /**
+   * @brief Decode value of the next field of the schema.
+   *
+   * @return `true` if read, `false` if the frame is too short or all fields are already read
+   */
+  bool read(double& value) {
+    if (field >= fields || error) {
+      return false;
+    }
+    const TelemetryField& f = schema[field++];
+    std::uint32_t raw;
+    switch (f.type) {
+      case TelemetryField::Type::Flag:
+      case TelemetryField::Type::UnsignedInt:
+        if (!read_bits(raw, f.bits)) {
+          return false;
+        }
+        value = raw;
+        return true;
+      case TelemetryField::Type::SignedInt:
+        if (!read_bits(raw, f.bits)) {
+          return false;
+        }
+        // sign extension
+        value = f.bits < 32 && (raw >> (f.bits - 1)) ? static_cast<double>(raw) - static_cast<double>(static_cast<std::uint64_t>(1) << f.bits)
+                                                     : static_cast<double>(static_cast<std::int32_t>(raw));
+        return true;
+      case TelemetryField::Type::Fixed:
+        if (!read_bits(raw, f.bits)) {
+          return false;
+        }
+        value = f.min + raw * f.resolution;
+        return true;
+      case TelemetryField::Type::Varint:
+        if (!read_varint(raw)) {
+          return false;
+        }
+        value = raw;
+        return true;
+      case TelemetryField::Type::Zigzag: {
+        std::int32_t n;
+        if (!read_zigzag(n)) {
+          return false;
+        }
+        value = n;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Read raw bits written with TelemetryWriter::write_bits().
+   *
+   * @return `true` if read, `false` if the frame is too short
+   */
+  bool read_bits(std::uint32_t& value, std::uint8_t bits) {
+    if (error || position + bits > length_bits) {
+      error = true;
+      return false;
+    }
+    value = 0;
+    for (std::uint8_t done = 0; done < bits;) {
+      std::uint8_t offset = position % 8;
+      std::uint8_t chunk = 8 - offset < bits - done ? 8 - offset : bits - done;
+      value |= static_cast<std::uint32_t>((data[position / 8] >> offset) & ((1u << chunk) - 1)) << done;
+      done += chunk;
+      position += chunk;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Read integer written with TelemetryWriter::write_varint().
+   *
+   * @return `true` if read, `false` if the frame is too short or the varint is malformed
+   */
+  bool read_varint(std::uint32_t& value) {
+    value = 0;
+    for (std::uint8_t shift = 0; shift < 35; shift += 7) {
+      std::uint32_t byte;
+      if (!read_bits(byte, 8)) {
+        return false;
+      }
+      value |= (byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        return true;
+      }
+    }
+    error = true;
+    return false;
+  }
+
+  /**
+   * @brief Read integer written with TelemetryWriter::write_zigzag().
+   *
+   * @return `true` if read, `false` if the frame is too short or the varint is malformed
+   */
+  bool read_zigzag(std::int32_t& value) {
+    std::uint32_t raw;
+    if (!read_varint(raw)) {
+      return false;
+    }
+    value = static_cast<std::int32_t>((raw >> 1) ^ (0u - (raw & 1)));
+    return true;
+  }
+
+  /**
+   * @brief Checks if the whole frame was read.
+   */
+  bool at_end() const {
+    return position + 8 > length_bits;
+  }
+
+  /**
+   * @brief Name of the field returned by the last read().
+   */
+  const char* name() const {
+    return field > 0 ? schema[field - 1].name : "";
+  }
+
+  /**
+   * @brief Checks if all fields read so far were complete.
+   */
+  bool ok() const {
+    return !error;
+  }
+
+ private:
+  const TelemetryField* schema;
+  std::uint8_t fields, field;
+  const std::uint8_t* data;
+  std::uint16_t length_bits, position;
+  bool error;
+};
+
+};  // namespace CanSatKit
+
+#endif  // CANSATKITLIBRARY_TELEMETRY_H_
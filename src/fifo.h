@@ -1,49 +1,288 @@
 #ifndef CANSATKITLIBRARY__FIFO_H_
 #define CANSATKITLIBRARY__FIFO_H_
 
+#include <atomic>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
-template<class T, uint16_t max_size>
-class FIFO {
+namespace CanSatKit {
+
+// Single-producer/single-consumer ring (eg. interrupt -> main loop) in storage given by the owner,
+// see FIFO for the one with its own storage.
+// Producer owns head, consumer owns tail, so neither side needs to block the other.
+// Indices run freely and are masked, max_size has to be a power of two.
+// Elements are copied with memcpy, so T has to be trivially copyable.
+template<class T>
+class FIFOBase {
  public:
-  FIFO() {
+  FIFOBase(T* data_, uint16_t max_size_) : max_size(max_size_), mask(max_size_ - 1), data(data_) {
     flush();
   }
-  
-  void append(T element) {
-    if (size() != max_size) {
-      count++;
-      writePos = (writePos + 1) % max_size;
-      data[writePos] = element;
+  FIFOBase(const FIFOBase&) = delete;
+  FIFOBase& operator=(const FIFOBase&) = delete;
+
+  // producer: false if there is no space (element is not stored)
+  bool push(const T& element) {
+    return push(&element, 1);
+  }
+
+  // producer: store all n elements or nothing
+  bool push(const T* elements, size_t n) {
+    uint16_t head = head_.load(std::memory_order_relaxed);
+    uint16_t tail = tail_.load(std::memory_order_acquire);
+    if (n > static_cast<uint16_t>(max_size - static_cast<uint16_t>(head - tail))) {
+      return false;
+    }
+    uint16_t pos = head & mask;
+    size_t first = max_size - pos;
+    if (first > n) {
+      first = n;
+    }
+    memcpy(&data[pos], elements, first * sizeof(T));
+    memcpy(&data[0], elements + first, (n - first) * sizeof(T));
+    head_.store(static_cast<uint16_t>(head + n), std::memory_order_release);
+    return true;
+  }
+
+  // consumer: false if empty
+  bool pop(T& element) {
+    return pop(&element, 1) == 1;
+  }
+
+  // consumer: get oldest element without removing it, false if empty
+  bool peek(T& element) const {
+    uint16_t tail = tail_.load(std::memory_order_relaxed);
+    if (static_cast<uint16_t>(head_.load(std::memory_order_acquire) - tail) == 0) {
+      return false;
     }
+    memcpy(&element, &data[tail & mask], sizeof(T));
+    return true;
   }
-  
-  T get() {
-    if (size() != 0) {
-      count--;
-      readPos = (readPos + 1) % max_size;
-      return data[readPos];
+
+  // consumer: get up to n elements, returns number of elements copied
+  size_t pop(T* elements, size_t n) {
+    uint16_t tail = tail_.load(std::memory_order_relaxed);
+    uint16_t head = head_.load(std::memory_order_acquire);
+    uint16_t available = head - tail;
+    if (n > available) {
+      n = available;
     }
-    return T();
+    uint16_t pos = tail & mask;
+    size_t first = max_size - pos;
+    if (first > n) {
+      first = n;
+    }
+    memcpy(elements, &data[pos], first * sizeof(T));
+    memcpy(elements + first, &data[0], (n - first) * sizeof(T));
+    tail_.store(static_cast<uint16_t>(tail + n), std::memory_order_release);
+    return n;
   }
-  
+
   size_t size() const {
-    return count;
+    return static_cast<uint16_t>(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
   }
 
   size_t free_space() const {
-    return max_size - count;
+    return max_size - size();
   }
-  
+
+  // not thread-safe, use only when neither side is running
   void flush() {
-    writePos = readPos = count = 0;
+    head_.store(0, std::memory_order_relaxed);
+    tail_.store(0, std::memory_order_relaxed);
   }
-  
+
+ private:
+  const uint16_t max_size, mask;
+  std::atomic<uint16_t> head_, tail_;
+  T* const data;
+};
+
+template<class T, uint16_t max_size>
+class FIFO : public FIFOBase<T> {
+  static_assert(max_size > 0 && (max_size & (max_size - 1)) == 0, "FIFO size has to be a power of two");
+  static_assert(max_size <= 32768, "FIFO size has to fit in 16-bit index");
+
+ public:
+  FIFO() : FIFOBase<T>(storage, max_size) {}
+
  private:
-  volatile uint16_t writePos, readPos, count;  
-  T data[max_size];
+  T storage[max_size];
 };
 
+// FIFO of variable-length frames kept as contiguous [length][payload] records,
+// so that SPI bursts can read/write the payload in place.
+// A zero length byte (or the end of the buffer) marks a wrap to the beginning.
+// Single producer/single consumer, same as FIFO. Storage is given by the owner, see FrameFIFO,
+// with max_size 0 nothing fits.
+class FrameFIFOBase {
+ public:
+  FrameFIFOBase(uint8_t* data_, uint16_t max_size_) : max_size(max_size_), data(data_) {
+    flush();
+  }
+  FrameFIFOBase(const FrameFIFOBase&) = delete;
+  FrameFIFOBase& operator=(const FrameFIFOBase&) = delete;
+
+  // producer: get space for a frame of given length, nullptr if it does not fit
+  uint8_t* reserve(uint8_t length) {
+    if (length == 0) {
+      return nullptr;
+    }
+    uint8_t* record = reserve_space(length + 1u);
+    return record ? record + 1 : nullptr;
+  }
+
+  // producer: publish previously reserved frame (length <= reserved length)
+  void commit(uint8_t length) {
+    if (reservedPos != writePos && writePos < max_size) {
+      data[writePos] = 0;
+    }
+    data[reservedPos] = length;
+    writePos = reservedPos + length + 1u;
+    pushed.store(pushed.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+  }
+
+  // producer: get space for several frames written directly as [length][payload] records,
+  // length is the total size of the records (at least 2 bytes, can be more than 255)
+  uint8_t* reserve_records(uint16_t length) {
+    return length >= 2 ? reserve_space(length) : nullptr;
+  }
+
+  // producer: publish all records at once, returns number of records not counting headers,
+  // 0 (nothing published) if they don't fill length exactly.
+  // First `headers` records are not frames (eg. metadata of the frames after them), frames() does not count them
+  // and the consumer removes them with skip(). At least one frame has to follow.
+  uint16_t commit_records(uint16_t length, uint8_t headers = 0) {
+    uint16_t pos = 0, count = 0;
+    while (pos < length) {
+      // zero length would be taken for a wrap
+      if (data[reservedPos + pos] == 0) {
+        return 0;
+      }
+      pos += data[reservedPos + pos] + 1u;
+      count++;
+    }
+    if (pos != length || count <= headers) {
+      return 0;
+    }
+    if (reservedPos != writePos && writePos < max_size) {
+      data[writePos] = 0;
+    }
+    writePos = reservedPos + length;
+    count -= headers;
+    pushed.store(pushed.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    return count;
+  }
+
+  // consumer: get oldest frame without removing it, nullptr if empty
+  const uint8_t* peek(uint8_t& length) {
+    if (frames() == 0) {
+      return nullptr;
+    }
+    uint16_t read = readPos.load(std::memory_order_relaxed);
+    if (read == max_size || data[read] == 0) {
+      read = 0;
+      readPos.store(read, std::memory_order_release);
+    }
+    length = data[read];
+    return &data[read + 1];
+  }
+
+  // consumer: remove oldest frame (the one returned by peek())
+  void release() {
+    remove();
+    popped.store(popped.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+  }
+
+  // consumer: remove oldest record returned by peek() when it is a header (see commit_records())
+  void skip() {
+    remove();
+  }
+
+  uint16_t frames() const {
+    return pushed.load(std::memory_order_acquire) - popped.load(std::memory_order_acquire);
+  }
+
+  // consumer (or producer while consumer is not running): call function(length) for each frame, oldest first
+  // (not for records with headers)
+  template<class Function>
+  void for_each(Function function) const {
+    uint16_t read = readPos.load(std::memory_order_relaxed);
+    for (uint16_t i = frames(); i > 0; --i) {
+      if (read == max_size || data[read] == 0) {
+        read = 0;
+      }
+      function(data[read]);
+      read += data[read] + 1u;
+    }
+  }
+
+  // not thread-safe, use only when neither side is running
+  void flush() {
+    writePos = reservedPos = 0;
+    readPos.store(0, std::memory_order_relaxed);
+    pushed.store(0, std::memory_order_relaxed);
+    popped.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  // space of given size at reservedPos, nullptr if it does not fit
+  uint8_t* reserve_space(uint16_t needed) {
+    // popped before readPos, so readPos is never older than the frame count
+    bool empty = popped.load(std::memory_order_acquire) == pushed.load(std::memory_order_relaxed);
+    uint16_t write = writePos, read = readPos.load(std::memory_order_acquire);
+    if (write == read && !empty) {
+      return nullptr;
+    }
+    if (write >= read) {
+      if (max_size - write >= needed) {
+        reservedPos = write;
+      } else if (needed <= read) {
+        reservedPos = 0;
+      } else {
+        return nullptr;
+      }
+    } else if (needed <= read - write) {
+      reservedPos = write;
+    } else {
+      return nullptr;
+    }
+    return &data[reservedPos];
+  }
+
+  void remove() {
+    uint16_t read = readPos.load(std::memory_order_relaxed);
+    // not peeked, the wrap is not skipped yet
+    if (read == max_size || data[read] == 0) {
+      read = 0;
+    }
+    readPos.store(read + data[read] + 1u, std::memory_order_release);
+  }
+
+  const uint16_t max_size;
+  uint16_t writePos, reservedPos;
+  std::atomic<uint16_t> readPos;
+  std::atomic<uint16_t> pushed, popped;
+  uint8_t* const data;
+};
+
+template<uint16_t size>
+class FrameFIFO : public FrameFIFOBase {
+ public:
+  FrameFIFO() : FrameFIFOBase(storage, size) {}
+
+ private:
+  uint8_t storage[size];
+};
+
+// no storage (eg. transmit-only radio)
+template<>
+class FrameFIFO<0> : public FrameFIFOBase {
+ public:
+  FrameFIFO() : FrameFIFOBase(nullptr, 0) {}
+};
+
+};  // namespace CanSatKit
+
 #endif  // CANSATKITLIBRARY__FIFO_H_
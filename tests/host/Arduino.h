@@ -0,0 +1,112 @@
+// Minimal Arduino API for running the library on a PC (host tests only).
+#ifndef CANSATKITLIBRARY_TESTS_HOST_ARDUINO_H_
+#define CANSATKITLIBRARY_TESTS_HOST_ARDUINO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define DEC 10
+#define HEX 16
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+      n += write(*buffer++);
+    }
+    return n;
+  }
+
+  size_t print(const char* str) { return write(reinterpret_cast<const uint8_t*>(str), strlen(str)); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(unsigned long value, int base = DEC) { return printf(base == HEX ? "%lX" : "%lu", value); }
+  size_t print(long value, int base = DEC) { return base == DEC ? printf("%ld", value) : print(static_cast<unsigned long>(value), base); }
+  size_t print(unsigned char value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(int value, int base = DEC) { return print(static_cast<long>(value), base); }
+  size_t print(unsigned int value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(double value, int digits = 2) { return printf("%.*f", digits, value); }
+  size_t println() { return print("\r\n"); }
+  template<class T> size_t println(T value) { return print(value) + println(); }
+  template<class T> size_t println(T value, int format) { return print(value, format) + println(); }
+
+ private:
+  template<class T> size_t printf(const char* format, T value) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), format, value);
+    return print(buffer);
+  }
+  template<class T> size_t printf(const char* format, int digits, T value) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), format, digits, value);
+    return print(buffer);
+  }
+};
+
+class String {
+ public:
+  String() {}
+  String(const char* str) : str_(str) {}
+  const char* c_str() const { return str_.c_str(); }
+  unsigned int length() const { return str_.size(); }
+  String& operator+=(const char* str) { str_ += str; return *this; }
+
+ private:
+  std::string str_;
+};
+
+// SerialUSB keeps everything printed, echo to stdout is optional
+class HostSerial : public Print {
+ public:
+  virtual size_t write(uint8_t c) {
+    output += static_cast<char>(c);
+    if (echo) {
+      std::fputc(c, stdout);
+    }
+    return 1;
+  }
+  void begin(unsigned long) {}
+  operator bool() const { return true; }
+
+  std::string output;
+  bool echo = false;
+};
+
+extern HostSerial SerialUSB;
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+inline int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int interrupt, void (*handler)(), int mode);
+void detachInterrupt(int interrupt);
+void noInterrupts();
+void interrupts();
+
+// time is simulated: it moves only when the host code (eg. SX1278Emulator) advances it
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+// busy-wait loops call it, advances simulated time on host
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+// host only: simulated clock in microseconds
+extern uint64_t host_time_us;
+// host only: called by delay() to let simulated devices run, advances host_time_us
+extern void (*host_run)(uint32_t duration_us);
+
+#endif  // CANSATKITLIBRARY_TESTS_HOST_ARDUINO_H_
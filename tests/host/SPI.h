@@ -0,0 +1,34 @@
+// Minimal Arduino SPI API for compiling the library on a PC (host tests only).
+// Nothing is connected: transfers return 0, use SX1278Emulator as radio transport instead.
+// Masking of the DIO0 interrupt by transactions is recorded for SPITransport tests.
+#ifndef CANSATKITLIBRARY_TESTS_HOST_SPI_H_
+#define CANSATKITLIBRARY_TESTS_HOST_SPI_H_
+
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+class SPISettings {
+ public:
+  SPISettings(uint32_t, int, int) {}
+};
+
+class SPIClass {
+ public:
+  void begin() {}
+  void end() {}
+  // as on SAMD: transaction masks the interrupt registered with usingInterrupt(), without nesting
+  void beginTransaction(SPISettings) { interrupt_masked = interrupt_registered; }
+  void endTransaction() { interrupt_masked = false; }
+  void usingInterrupt(int) { interrupt_registered = true; }
+  void notUsingInterrupt(int) { interrupt_registered = false; }
+  uint8_t transfer(uint8_t) { return 0; }
+
+  bool interrupt_registered = false;
+  bool interrupt_masked = false;
+};
+
+extern SPIClass SPI;
+
+#endif  // CANSATKITLIBRARY_TESTS_HOST_SPI_H_
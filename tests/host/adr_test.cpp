@@ -0,0 +1,232 @@
+// Adaptive data rate between the can (AdrFollower on Radio, SX1278 emulator) and
+// the ground station (AdrController on a simple model of the other radio) over a channel of given SNR.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc -Itests/host tests/host/adr_test.cpp tests/host/sx1278_emulator.cpp
+//     tests/host/arduino.cpp src/CanSatKitRadio*.cpp -o adr_test && ./adr_test
+
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+#include "Arduino.h"
+#include "CanSatKit.h"
+#include "CanSatKitAdr.h"
+#include "host_test.h"
+#include "sx1278_emulator.h"
+
+using namespace CanSatKit;
+
+static SX1278Emulator module;
+static Radio radio(module, Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8));
+
+// SNR of the channel in 125 kHz bandwidth (noise grows with bandwidth)
+static double channel_snr = 0;
+
+static double snr_in(Radio::Bandwidth bandwidth) {
+  return channel_snr - 10 * std::log10(Radio::bandwidth_in_hz(bandwidth) / 125000.0);
+}
+
+static bool same_modem(const Radio::Config& a, const Radio::Config& b) {
+  return a.bandwidth == b.bandwidth && a.spreadingFactor == b.spreadingFactor;
+}
+
+// Ground station radio: frames go to module if both use the same modem settings
+// and the SNR is above the demodulation limit.
+class GroundRadio {
+ public:
+  GroundRadio() : config(radio.get_config()), next_seen(module.transmitted.size()), busy_until(host_time_us) {}
+
+  const Radio::Config& get_config() const { return config; }
+  bool set_config(const Radio::Config& config_) {
+    config = config_;
+    return true;
+  }
+
+  bool transmit(const uint8_t* data, uint8_t length) {
+    uint64_t start = busy_until > host_time_us ? busy_until : host_time_us + turnaround_us;
+    busy_until = start + config.time_on_air(length);
+    outgoing.push_back(Outgoing{std::vector<uint8_t>(data, data + length), start, config});
+    return true;
+  }
+
+  // frames from the can for AdrController::handle()
+  struct Received {
+    std::vector<uint8_t> payload;
+    float snr;
+    int rssi;
+  };
+  std::deque<Received> received;
+
+  void service() {
+    while (!outgoing.empty() && outgoing.front().start <= host_time_us) {
+      auto& frame = outgoing.front();
+      if (same_modem(frame.config, radio.get_config()) && snr_in(frame.config.bandwidth) >= Radio::demodulation_snr(frame.config.spreadingFactor)) {
+        module.receive(frame.payload, rssi(frame.config.bandwidth), snr(frame.config.bandwidth));
+      }
+      outgoing.pop_front();
+    }
+    while (next_seen < module.transmitted.size() && module.transmitted[next_seen].end_us <= host_time_us) {
+      auto& packet = module.transmitted[next_seen++];
+      // the can switches settings only between frames, duration tells which ones were used
+      uint32_t duration = packet.end_us - packet.start_us;
+      uint32_t expected = config.time_on_air(packet.payload.size());
+      if ((duration > expected ? duration - expected : expected - duration) <= 2
+          && snr_in(config.bandwidth) >= Radio::demodulation_snr(config.spreadingFactor)) {
+        received.push_back(Received{packet.payload, snr(config.bandwidth), rssi(config.bandwidth)});
+      }
+    }
+  }
+
+ private:
+  struct Outgoing {
+    std::vector<uint8_t> payload;
+    uint64_t start;
+    Radio::Config config;
+  };
+
+  // measured SNR saturates
+  static float snr(Radio::Bandwidth bandwidth) {
+    return std::fmin(snr_in(bandwidth), 10.0);
+  }
+
+  // power of signal and noise (noise floor with 6 dB noise figure)
+  static int rssi(Radio::Bandwidth bandwidth) {
+    double noise = -174 + 10 * std::log10(Radio::bandwidth_in_hz(bandwidth)) + 6;
+    return static_cast<int>(std::lround(noise + 10 * std::log10(1 + std::pow(10, snr_in(bandwidth) / 10))));
+  }
+
+  static constexpr uint64_t turnaround_us = 10000;
+
+  Radio::Config config;
+  size_t next_seen;
+  uint64_t busy_until;
+  std::deque<Outgoing> outgoing;
+};
+
+static GroundRadio ground_radio;
+static AdrFollower<> can(radio);
+static AdrController<GroundRadio> ground(ground_radio);
+static uint32_t telemetry_received = 0;
+
+// run both sides, the can sends telemetry leaving a gap for commands after each frame
+static void run(uint32_t duration_ms) {
+  static uint64_t idle_since = 0;
+  static const uint8_t telemetry[20] = {'T'};
+  uint64_t end = host_time_us + duration_ms * 1000ull;
+  while (host_time_us < end) {
+    uint8_t length;
+    const uint8_t* frame;
+    while ((frame = radio.peek(length)) != nullptr) {
+      can.handle(frame, length);
+      radio.release();
+    }
+    can.poll();
+    if (radio.tx_fifo_empty() && radio.tx_queue_time() == 0) {
+      if (idle_since == 0) {
+        idle_since = host_time_us;
+      } else if (host_time_us - idle_since > 2 * radio.time_on_air(AdrLink<Radio>::frame_length) + 50000) {
+        radio.transmit(telemetry, sizeof(telemetry));
+        idle_since = 0;
+      }
+    } else {
+      idle_since = 0;
+    }
+
+    ground_radio.service();
+    while (!ground_radio.received.empty()) {
+      auto& received = ground_radio.received.front();
+      if (!ground.handle(received.payload.data(), received.payload.size(), received.snr, received.rssi)) {
+        telemetry_received++;
+      }
+      ground_radio.received.pop_front();
+    }
+    ground.poll();
+    SX1278Emulator::run(1000);
+  }
+}
+
+static uint32_t telemetry_rate(uint32_t duration_ms) {
+  uint32_t before = telemetry_received;
+  run(duration_ms);
+  return telemetry_received - before;
+}
+
+static void starts_with_robust_profile() {
+  CHECK(radio.begin());
+  CHECK(can.begin());
+  CHECK(ground.begin());
+  CHECK(can.profile() == 0 && ground.profile() == 0);
+  CHECK(radio.get_config().spreadingFactor == SpreadingFactor_12);
+  CHECK(radio.get_config().bandwidth == Bandwidth_125000_Hz);
+}
+
+static void steps_up_with_high_snr() {
+  // too weak for anything faster than the first profile
+  channel_snr = -15;
+  uint32_t slow = telemetry_rate(60000);
+  CHECK(can.profile() == 0);
+
+  channel_snr = 15;
+  run(240000);
+  CHECK(can.profile() == adr_default_profile_count - 1);
+  CHECK(ground.profile() == can.profile());
+  CHECK(radio.get_config().bandwidth == Bandwidth_500000_Hz);
+  uint32_t fast = telemetry_rate(60000);
+  std::printf("  telemetry frames per minute: %u at SF12 125 kHz, %u at SF7 500 kHz\n", slow, fast);
+  CHECK(fast > 10 * slow);
+}
+
+static void steps_down_when_snr_drops() {
+  // SF8 at 125 kHz keeps the margin
+  channel_snr = 2;
+  run(60000);
+  CHECK(can.profile() == 4);
+  CHECK(ground.profile() == 4);
+  CHECK(ground.margin() >= 0);
+  CHECK(telemetry_rate(30000) > 0);
+}
+
+static void falls_back_when_link_is_lost() {
+  channel_snr = -40;
+  run(40000);
+  CHECK(can.profile() == 0);
+  CHECK(ground.profile() == 0);
+  CHECK(radio.get_config().spreadingFactor == SpreadingFactor_12);
+
+  // and starts again from the robust profile
+  channel_snr = 2;
+  run(180000);
+  CHECK(can.profile() == 4);
+  CHECK(ground.profile() == 4);
+}
+
+static void ignores_other_frames() {
+  uint8_t profile = can.profile();
+  // unknown type, data after the control frame, other marker
+  const uint8_t frames[][5] = {
+    {0xAD, 3, 0, 1, 0},
+    {0xAD, 1, 0, 1, 5},
+    {0xAC, 1, 0, 1, 0},
+  };
+  CHECK(!can.handle(frames[0], 4));
+  CHECK(!can.handle(frames[1], 5));
+  CHECK(!can.handle(frames[2], 4));
+  CHECK(!can.handle(frames[0], 3));
+  // padded with zeros (implicit header mode), but no such profile
+  const uint8_t unknown_profile[] = {0xAD, 1, 200, 1, 0, 0};
+  CHECK(can.handle(unknown_profile, sizeof(unknown_profile)));
+  CHECK(can.profile() == profile);
+}
+
+int main() {
+  radio.disable_debug();
+
+  RUN_TEST(starts_with_robust_profile);
+  RUN_TEST(steps_up_with_high_snr);
+  RUN_TEST(steps_down_when_snr_drops);
+  RUN_TEST(falls_back_when_link_is_lost);
+  RUN_TEST(ignores_other_frames);
+
+  return host_test_result("adr_test");
+}
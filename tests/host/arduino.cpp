@@ -0,0 +1,55 @@
+// Minimal Arduino API for running the library on a PC (host tests only).
+#include <cstdlib>
+
+#include "Arduino.h"
+#include "SPI.h"
+
+HostSerial SerialUSB;
+SPIClass SPI;
+
+uint64_t host_time_us = 0;
+void (*host_run)(uint32_t duration_us) = nullptr;
+
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+int digitalRead(int) { return LOW; }
+void attachInterrupt(int, void (*)(), int) {}
+void detachInterrupt(int) {}
+void noInterrupts() {}
+void interrupts() {}
+
+uint32_t micros() {
+  return static_cast<uint32_t>(host_time_us);
+}
+
+uint32_t millis() {
+  return static_cast<uint32_t>(host_time_us / 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  if (host_run) {
+    host_run(us);
+  } else {
+    host_time_us += us;
+  }
+}
+
+void yield() {
+  delayMicroseconds(10);
+}
+
+void delay(uint32_t ms) {
+  delayMicroseconds(ms * 1000);
+}
+
+long random(long max) {
+  return max > 0 ? std::rand() % max : 0;
+}
+
+long random(long min, long max) {
+  return min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+  std::srand(seed);
+}
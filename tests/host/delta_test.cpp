@@ -0,0 +1,131 @@
+// DeltaEncoder/DeltaDecoder on a simulated BMP280 series.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc tests/host/delta_test.cpp -o delta_test && ./delta_test
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "CanSatKitDeltaCodec.h"
+#include "host_test.h"
+
+using namespace CanSatKit;
+
+struct Sample {
+  double T, P;
+};
+
+// slow descent under parachute, 10 samples per second, noise of BMP280 with oversampling 16
+static std::vector<Sample> bmp280_series(int count) {
+  std::vector<Sample> series;
+  uint32_t state = 1;
+  for (int i = 0; i < count; ++i) {
+    state = state * 1103515245u + 12345u;
+    double noise = ((state >> 8) % 100) / 100.0 - 0.5;
+    series.push_back({15.0 + i * 0.001 + noise * 0.02, 900.0 + i * 0.012 + noise * 0.004});
+  }
+  return series;
+}
+
+static std::vector<std::vector<uint8_t>> encode(const std::vector<Sample>& series, uint8_t max_length) {
+  std::vector<std::vector<uint8_t>> frames;
+  DeltaEncoder<2> encoder({0.01, 0.01}, max_length);
+  for (auto& s : series) {
+    double sample[2] = {s.T, s.P};
+    if (!encoder.add(sample)) {
+      frames.emplace_back(encoder.data(), encoder.data() + encoder.size());
+      encoder.next_frame();
+      encoder.add(sample);
+    }
+  }
+  frames.emplace_back(encoder.data(), encoder.data() + encoder.size());
+  return frames;
+}
+
+static void round_trip() {
+  auto series = bmp280_series(2000);
+  auto frames = encode(series, 255);
+
+  DeltaDecoder<2> decoder({0.01, 0.01});
+  size_t decoded = 0;
+  bool ok = true;
+  for (auto& frame : frames) {
+    CHECK(decoder.begin(frame.data(), frame.size()));
+    double sample[2];
+    while (decoder.next(sample)) {
+      ok = ok && std::fabs(sample[0] - series[decoded].T) <= 0.005 + 1e-9;
+      ok = ok && std::fabs(sample[1] - series[decoded].P) <= 0.005 + 1e-9;
+      decoded++;
+    }
+  }
+  CHECK(ok);
+  CHECK(decoded == series.size());
+  CHECK(decoder.lost() == 0);
+
+  size_t bytes = 0;
+  for (auto& frame : frames) {
+    bytes += frame.size();
+  }
+  char text[64];
+  size_t text_bytes = 0;
+  for (auto& s : series) {
+    text_bytes += std::snprintf(text, sizeof(text), "%.2f;%.2f", s.T, s.P);
+  }
+  std::printf("  %zu samples: %zu frames, %.2f bytes/sample (text %.2f bytes/sample)\n", series.size(), frames.size(),
+              static_cast<double>(bytes) / series.size(), static_cast<double>(text_bytes) / series.size());
+  // 1 byte per channel per sample most of the time
+  CHECK(bytes < series.size() * 2.2);
+}
+
+static void resync_after_lost_frame() {
+  auto series = bmp280_series(500);
+  auto frames = encode(series, 64);
+  CHECK(frames.size() > 3);
+
+  DeltaDecoder<2> decoder({0.01, 0.01});
+  size_t decoded = 0;
+  double sample[2], last[2] = {0, 0};
+  for (size_t i = 0; i < frames.size(); ++i) {
+    if (i == 1) {
+      continue;
+    }
+    CHECK(decoder.begin(frames[i].data(), frames[i].size()));
+    while (decoder.next(sample)) {
+      last[0] = sample[0];
+      last[1] = sample[1];
+      decoded++;
+    }
+  }
+  CHECK(decoder.lost() == 1);
+  CHECK(decoded < series.size());
+  // samples after the gap are exact again
+  CHECK(std::fabs(last[0] - series.back().T) <= 0.005 + 1e-9);
+  CHECK(std::fabs(last[1] - series.back().P) <= 0.005 + 1e-9);
+}
+
+static void large_jumps() {
+  DeltaEncoder<1> encoder({1.0}, 20);
+  const double values[] = {0, 2147483647.0, -2147483648.0, 1e12, -5};
+  for (double v : values) {
+    double sample[1] = {v};
+    CHECK(encoder.add(sample));
+  }
+  DeltaDecoder<1> decoder({1.0});
+  CHECK(decoder.begin(encoder.data(), encoder.size()));
+  const double expected[] = {0, 2147483647.0, -2147483648.0, 2147483647.0, -5};
+  for (double e : expected) {
+    double sample[1];
+    CHECK(decoder.next(sample));
+    CHECK(sample[0] == e);
+  }
+  double sample[1];
+  CHECK(!decoder.next(sample));
+}
+
+int main() {
+  RUN_TEST(round_trip);
+  RUN_TEST(resync_after_lost_frame);
+  RUN_TEST(large_jumps);
+
+  return host_test_result("delta_test");
+}
@@ -0,0 +1,110 @@
+// Erasure coding cost per block and delivered data at random frame loss.
+// Host CPU time is only a relative measure; byte operations per block give
+// the cost on the board (each is a few table lookups).
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc tests/host/erasure_bench.cpp src/CanSatKitErasureCode.cpp -o erasure_bench && ./erasure_bench
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "CanSatKitErasureCode.h"
+
+using namespace CanSatKit;
+
+static double host_clock_us() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+template<uint8_t K, uint8_t M>
+static void bench_block(uint8_t length) {
+  static ErasureEncoder<K, M> encoder;
+  static ErasureDecoder<K, M> decoder;
+  constexpr int blocks = 2000;
+  std::vector<uint8_t> data(length, 0xA5);
+  std::vector<std::vector<uint8_t>> frames;
+  const uint8_t* frame;
+  uint8_t frame_length;
+
+  double encode_us = 0, decode_us = 0;
+  for (int b = 0; b < blocks; ++b) {
+    frames.clear();
+    double start = host_clock_us();
+    for (int i = 0; i < K; ++i) {
+      data[0] = i;
+      encoder.add(data.data(), length);
+      while (encoder.next(frame, frame_length)) {
+        frames.emplace_back(frame, frame + frame_length);
+      }
+    }
+    encode_us += host_clock_us() - start;
+
+    // worst case: first M data frames lost
+    start = host_clock_us();
+    for (size_t i = M; i < frames.size(); ++i) {
+      decoder.add(frames[i].data(), frames[i].size());
+      while (decoder.next(frame, frame_length)) {
+      }
+    }
+    decode_us += host_clock_us() - start;
+  }
+
+  // encoder: K * M multiply-adds of a frame; decoder: removing K - M data from M parity + elimination
+  uint32_t codeword = length + 1u;
+  uint32_t encode_ops = K * M * codeword;
+  uint32_t decode_ops = (M * (K - M) + M * M) * codeword;
+  std::printf("  K=%2u M=%u %3u B: encode %6.1f us (%5u byte ops), decode %6.1f us (%5u byte ops) per block\n",
+              K, M, length, encode_us / blocks, encode_ops, decode_us / blocks, decode_ops);
+}
+
+template<uint8_t K, uint8_t M>
+static void delivered_at_loss(double loss) {
+  static ErasureEncoder<K, M> encoder;
+  static ErasureDecoder<K, M> decoder;
+  std::mt19937 random(1);
+  std::bernoulli_distribution lost(loss);
+  constexpr int data_frames = 100000;
+  uint8_t data[32] = {};
+  const uint8_t* frame;
+  uint8_t length;
+  int sent = 0, plain = 0, delivered = 0;
+  for (int i = 0; i < data_frames; ++i) {
+    plain += !lost(random);
+    encoder.add(data, sizeof(data));
+    while (encoder.next(frame, length)) {
+      sent++;
+      if (lost(random)) {
+        continue;
+      }
+      decoder.add(frame, length);
+      const uint8_t* out;
+      uint8_t out_length;
+      while (decoder.next(out, out_length)) {
+        delivered++;
+      }
+    }
+  }
+  std::printf("  K=%2u M=%u, %2.0f%% frames lost: delivered %5.1f%% (without coding %5.1f%%), %3.0f%% more frames\n",
+              K, M, loss * 100, 100.0 * delivered / data_frames, 100.0 * plain / data_frames,
+              100.0 * (sent - data_frames) / data_frames);
+}
+
+int main() {
+  std::printf("cost per block:\n");
+  bench_block<4, 2>(252);
+  bench_block<8, 2>(252);
+  bench_block<8, 4>(252);
+  bench_block<16, 4>(252);
+  bench_block<8, 2>(32);
+
+  std::printf("delivered data:\n");
+  delivered_at_loss<8, 2>(0.1);
+  delivered_at_loss<8, 4>(0.1);
+  delivered_at_loss<16, 4>(0.1);
+  delivered_at_loss<4, 2>(0.1);
+  delivered_at_loss<8, 2>(0.2);
+  delivered_at_loss<8, 4>(0.2);
+  return 0;
+}
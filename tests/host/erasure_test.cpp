@@ -0,0 +1,166 @@
+// Round trip of CanSatKitErasureCode.h encoder/decoder with lost frames.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc tests/host/erasure_test.cpp src/CanSatKitErasureCode.cpp -o erasure_test && ./erasure_test
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CanSatKitErasureCode.h"
+#include "host_test.h"
+
+using namespace CanSatKit;
+
+typedef std::vector<uint8_t> Frame;
+
+static Frame make_data(int i) {
+  Frame data(1 + (i * 37) % 200);
+  for (size_t k = 0; k < data.size(); ++k) {
+    data[k] = static_cast<uint8_t>(i * 13 + k * 7);
+  }
+  return data;
+}
+
+// encode data frames, returns all frames to transmit
+template<uint8_t K, uint8_t M>
+static std::vector<Frame> encode(ErasureEncoder<K, M>& encoder, int first, int count) {
+  std::vector<Frame> frames;
+  for (int i = first; i < first + count; ++i) {
+    Frame data = make_data(i);
+    encoder.add(data.data(), data.size());
+    const uint8_t* frame;
+    uint8_t length;
+    while (encoder.next(frame, length)) {
+      frames.push_back(Frame(frame, frame + length));
+    }
+  }
+  return frames;
+}
+
+// decode frames not marked in lost mask, returns decoded data frames
+template<uint8_t K, uint8_t M>
+static std::vector<Frame> decode(ErasureDecoder<K, M>& decoder, const std::vector<Frame>& frames, uint32_t lost) {
+  std::vector<Frame> result;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    if (lost & (1u << (i % 32))) {
+      continue;
+    }
+    decoder.add(frames[i].data(), frames[i].size());
+    const uint8_t* data;
+    uint8_t length;
+    while (decoder.next(data, length)) {
+      result.push_back(Frame(data, data + length));
+    }
+  }
+  return result;
+}
+
+static bool contains(const std::vector<Frame>& frames, const Frame& frame) {
+  for (auto& f : frames) {
+    if (f == frame) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void no_loss() {
+  ErasureEncoder<8, 2> encoder;
+  ErasureDecoder<8, 2> decoder;
+  auto frames = encode(encoder, 0, 16);
+  CHECK(frames.size() == 20);
+  // parity frames follow every 8 data frames
+  CHECK(frames[8][1] == 8 && frames[9][1] == 9 && frames[10][0] == 1 && frames[10][1] == 0);
+  auto decoded = decode(decoder, frames, 0);
+  CHECK(decoded.size() == 16);
+  for (int i = 0; i < 16; ++i) {
+    CHECK(decoded[i] == make_data(i));
+  }
+  CHECK(decoder.recovered() == 0 && decoder.lost() == 0);
+}
+
+// every pattern of up to M lost frames in a block of K + M
+template<uint8_t K, uint8_t M>
+static void every_loss_pattern() {
+  const int n = K + M;
+  for (uint32_t lost = 0; lost < (1u << n); ++lost) {
+    int lost_count = __builtin_popcount(lost);
+    if (lost_count > M) {
+      continue;
+    }
+    ErasureEncoder<K, M> encoder;
+    ErasureDecoder<K, M> decoder;
+    auto frames = encode(encoder, 0, K);
+    auto decoded = decode(decoder, frames, lost);
+    CHECK(decoded.size() == K);
+    for (int i = 0; i < K; ++i) {
+      CHECK(contains(decoded, make_data(i)));
+    }
+    int lost_data = __builtin_popcount(lost & ((1u << K) - 1));
+    CHECK(decoder.recovered() == static_cast<uint32_t>(lost_data));
+  }
+}
+
+static void every_loss_pattern_8_2() {
+  every_loss_pattern<8, 2>();
+}
+
+static void every_loss_pattern_4_4() {
+  every_loss_pattern<4, 4>();
+}
+
+static void too_many_losses() {
+  ErasureEncoder<8, 2> encoder;
+  ErasureDecoder<8, 2> decoder;
+  auto frames = encode(encoder, 0, 16);
+  // 3 frames of the first block lost, nothing can be rebuilt
+  auto decoded = decode(decoder, frames, (1u << 1) | (1u << 4) | (1u << 9));
+  CHECK(decoded.size() == 6 + 8);
+  CHECK(decoder.recovered() == 0);
+  CHECK(decoder.lost() == 2);
+}
+
+static void lost_blocks() {
+  ErasureEncoder<4, 2> encoder;
+  ErasureDecoder<4, 2> decoder;
+  auto frames = encode(encoder, 0, 12);
+  // whole second block lost
+  auto decoded = decode(decoder, frames, 0x3Fu << 6);
+  CHECK(decoded.size() == 8);
+  CHECK(decoder.lost() == 4);
+}
+
+static void encoder_limits() {
+  ErasureEncoder<2, 1> encoder(254);
+  uint8_t data[255] = {};
+  CHECK(encoder.max_length() == 251);
+  CHECK(!encoder.add(data, 0));
+  CHECK(!encoder.add(data, 252));
+  CHECK(encoder.add(data, 251) && encoder.add(data, 251));
+  const uint8_t* frame;
+  uint8_t length;
+  CHECK(encoder.next(frame, length) && length == 253);
+  // parity carries length byte
+  CHECK(encoder.next(frame, length) && length == 254);
+  CHECK(!encoder.next(frame, length));
+}
+
+static void gf256() {
+  for (int a = 1; a < 256; ++a) {
+    CHECK(GF256::multiply(a, GF256::inverse(a)) == 1);
+  }
+  // x^8 = x^4 + x^3 + x^2 + 1
+  CHECK(GF256::multiply(0x80, 0x02) == 0x1D);
+}
+
+int main() {
+  RUN_TEST(gf256);
+  RUN_TEST(no_loss);
+  RUN_TEST(every_loss_pattern_8_2);
+  RUN_TEST(every_loss_pattern_4_4);
+  RUN_TEST(too_many_losses);
+  RUN_TEST(lost_blocks);
+  RUN_TEST(encoder_limits);
+
+  return host_test_result("erasure_test");
+}
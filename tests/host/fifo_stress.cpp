@@ -0,0 +1,252 @@
+// Host-side stress test of fifo.h: a second thread plays the radio interrupt.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -pthread -Isrc -Itests/host tests/host/fifo_stress.cpp -o fifo_stress && ./fifo_stress
+
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <thread>
+
+#include "fifo.h"
+#include "host_test.h"
+
+using namespace CanSatKit;
+
+// deterministic pseudo-random sequence, separate for each thread
+static uint32_t next_random(uint32_t& state) {
+  state = state * 1103515245u + 12345u;
+  return state >> 8;
+}
+
+static void ring_single_thread() {
+  FIFO<uint8_t, 8> fifo;
+  const uint8_t data[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  uint8_t out[10];
+
+  CHECK(fifo.push(data, 6));
+  CHECK(!fifo.push(data, 3));
+  CHECK(fifo.size() == 6);
+  CHECK(fifo.pop(out, 4) == 4);
+  // peek leaves the element in the ring
+  CHECK(fifo.peek(out[0]) && out[0] == 4);
+  CHECK(fifo.size() == 2);
+  // wraps around the end of the buffer
+  CHECK(fifo.push(data + 6, 4));
+  CHECK(fifo.free_space() == 2);
+  CHECK(fifo.pop(out, 10) == 6);
+  for (int i = 0; i < 6; ++i) {
+    CHECK(out[i] == 4 + i);
+  }
+  CHECK(!fifo.pop(out[0]));
+}
+
+static void ring_two_threads() {
+  constexpr uint32_t count = 5000000;
+  static FIFO<uint32_t, 1024> fifo;
+
+  // "interrupt" produces a continuous sequence in random-sized bursts
+  std::thread isr([] {
+    uint32_t state = 1, value = 0, chunk[64];
+    while (value < count) {
+      uint32_t n = 1 + next_random(state) % 64;
+      if (n > count - value) {
+        n = count - value;
+      }
+      for (uint32_t i = 0; i < n; ++i) {
+        chunk[i] = value + i;
+      }
+      if (fifo.push(chunk, n)) {
+        value += n;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t state = 2, expected = 0, chunk[64];
+  bool ok = true;
+  while (expected < count) {
+    size_t n = fifo.pop(chunk, 1 + next_random(state) % 64);
+    if (n == 0) {
+      std::this_thread::yield();
+    }
+    for (size_t i = 0; i < n; ++i) {
+      ok = ok && chunk[i] == expected++;
+    }
+  }
+  isr.join();
+  CHECK(ok);
+  CHECK(fifo.size() == 0);
+}
+
+static void fill_frame(uint8_t* data, uint8_t length, uint32_t sequence) {
+  for (uint8_t i = 0; i < length; ++i) {
+    data[i] = static_cast<uint8_t>(sequence * 31 + i);
+  }
+}
+
+static void frames_single_thread() {
+  static FrameFIFO<2571> fifo;
+  uint8_t length;
+
+  // one frame sent right away, then ten full frames fit as before
+  CHECK(fifo.reserve(255) != nullptr);
+  fifo.commit(255);
+  CHECK(fifo.peek(length) != nullptr && length == 255);
+  fifo.release();
+  for (int i = 0; i < 10; ++i) {
+    CHECK(fifo.reserve(255) != nullptr);
+    fifo.commit(255);
+  }
+  CHECK(fifo.reserve(1) == nullptr);
+  CHECK(fifo.frames() == 10);
+  // frames can be dropped without peek, also across the wrap
+  for (int i = 0; i < 10; ++i) {
+    fifo.release();
+  }
+  CHECK(fifo.reserve(1) != nullptr);
+  fifo.commit(1);
+  CHECK(fifo.peek(length) != nullptr && length == 1);
+
+  // reserved space can be committed shorter
+  fifo.flush();
+  auto frame = fifo.reserve(255);
+  CHECK(frame != nullptr);
+  fill_frame(frame, 3, 7);
+  fifo.commit(3);
+  auto view = fifo.peek(length);
+  CHECK(view == frame && length == 3);
+  fifo.release();
+  CHECK(fifo.peek(length) == nullptr);
+}
+
+static void frames_records() {
+  static FrameFIFO<2571> fifo;
+  uint8_t length;
+
+  // three frames written at once as [length][payload] records
+  auto records = fifo.reserve_records(9);
+  CHECK(records != nullptr);
+  const uint8_t packed[] = {2, 'a', 'b', 1, 'c', 3, 'd', 'e', 'f'};
+  memcpy(records, packed, sizeof(packed));
+  CHECK(fifo.commit_records(sizeof(packed)) == 3);
+  CHECK(fifo.frames() == 3);
+  auto frame = fifo.peek(length);
+  CHECK(length == 2 && frame[0] == 'a');
+  fifo.release();
+  frame = fifo.peek(length);
+  CHECK(length == 1 && frame[0] == 'c');
+  fifo.release();
+  frame = fifo.peek(length);
+  CHECK(length == 3 && frame[2] == 'f');
+  fifo.release();
+
+  // header record before a frame (together more than 255 bytes), not counted as a frame
+  records = fifo.reserve_records(3 + 256);
+  CHECK(records != nullptr);
+  records[0] = 2;
+  records[1] = 'h';
+  records[2] = 'd';
+  records[3] = 255;
+  memset(&records[4], 'x', 255);
+  CHECK(fifo.commit_records(3 + 256, 1) == 1);
+  CHECK(fifo.frames() == 1);
+  frame = fifo.peek(length);
+  CHECK(length == 2 && frame[0] == 'h');
+  fifo.skip();
+  frame = fifo.peek(length);
+  CHECK(length == 255 && frame[254] == 'x');
+  fifo.release();
+  CHECK(fifo.frames() == 0);
+  // a header alone is not published
+  records = fifo.reserve_records(3);
+  memcpy(records, packed, 3);
+  CHECK(!fifo.commit_records(3, 1));
+
+  // records not matching the length are not published
+  const uint8_t overflowing[] = {2, 'a', 'b', 4, 'c'};
+  const uint8_t zero_length[] = {2, 'a', 'b', 0, 'c'};
+  for (auto bad : {overflowing, zero_length}) {
+    records = fifo.reserve_records(5);
+    CHECK(records != nullptr);
+    memcpy(records, bad, 5);
+    CHECK(!fifo.commit_records(5));
+    CHECK(fifo.frames() == 0);
+  }
+  // a frame written afterwards is fine
+  CHECK(fifo.reserve(1) != nullptr);
+  fifo.commit(1);
+  CHECK(fifo.peek(length) != nullptr && length == 1);
+  fifo.release();
+  CHECK(fifo.peek(length) == nullptr);
+}
+
+static void frames_two_threads(bool isr_is_producer) {
+  constexpr uint32_t count = 500000;
+  static FrameFIFO<2571> fifo;
+  fifo.flush();
+
+  auto producer = [] {
+    uint32_t state = 3, sequence = 0;
+    while (sequence < count) {
+      uint8_t length = 1 + next_random(state) % 255;
+      uint8_t* frame;
+      while ((frame = fifo.reserve(length)) == nullptr) {
+        std::this_thread::yield();
+      }
+      fill_frame(frame, length, sequence++);
+      fifo.commit(length);
+    }
+  };
+
+  auto consumer = [](bool& ok) {
+    uint32_t state = 3, sequence = 0;
+    uint8_t expected[255];
+    while (sequence < count) {
+      uint8_t length;
+      auto frame = fifo.peek(length);
+      if (frame) {
+        uint8_t expected_length = 1 + next_random(state) % 255;
+        fill_frame(expected, expected_length, sequence++);
+        ok = ok && length == expected_length && memcmp(frame, expected, length) == 0;
+        fifo.release();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  };
+
+  bool ok = true;
+  if (isr_is_producer) {
+    std::thread isr(producer);
+    consumer(ok);
+    isr.join();
+  } else {
+    std::thread isr(consumer, std::ref(ok));
+    producer();
+    isr.join();
+  }
+  CHECK(ok);
+  CHECK(fifo.frames() == 0);
+}
+
+static void frames_rx() {
+  frames_two_threads(true);
+}
+
+static void frames_tx() {
+  frames_two_threads(false);
+}
+
+int main() {
+  RUN_TEST(ring_single_thread);
+  RUN_TEST(ring_two_threads);
+  RUN_TEST(frames_single_thread);
+  RUN_TEST(frames_records);
+  // RX: interrupt fills frames, main loop reads them
+  RUN_TEST(frames_rx);
+  // TX: main loop fills frames, interrupt sends them
+  RUN_TEST(frames_tx);
+
+  return host_test_result("fifo_stress");
+}
@@ -0,0 +1,29 @@
+// Tiny test helpers for host tests.
+#ifndef CANSATKITLIBRARY_TESTS_HOST_HOST_TEST_H_
+#define CANSATKITLIBRARY_TESTS_HOST_HOST_TEST_H_
+
+#include <cstdio>
+
+static int host_test_failures = 0;
+
+// check condition, leave the test function on failure
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      host_test_failures++; \
+      return; \
+    } \
+  } while (0)
+
+#define RUN_TEST(test) do { \
+    int failures_before = host_test_failures; \
+    test(); \
+    std::printf("%-40s %s\n", #test, host_test_failures == failures_before ? "ok" : "FAILED"); \
+  } while (0)
+
+static int host_test_result(const char* name) {
+  std::printf("%s: %s\n", name, host_test_failures ? "FAILED" : "passed");
+  return host_test_failures ? 1 : 0;
+}
+
+#endif  // CANSATKITLIBRARY_TESTS_HOST_HOST_TEST_H_
@@ -0,0 +1,331 @@
+// Radio throughput against the SX1278 emulator: airtime utilisation, SPI traffic
+// and host CPU time per frame, for regression tracking.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc -Itests/host tests/host/radio_bench.cpp tests/host/sx1278_emulator.cpp
+//     tests/host/arduino.cpp src/CanSatKitRadio*.cpp -o radio_bench && ./radio_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Arduino.h"
+#include "CanSatKit.h"
+#include "sx1278_emulator.h"
+
+using namespace CanSatKit;
+
+static SX1278Emulator module;
+static Radio radio(module, Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8));
+
+static constexpr int frames = 2000;
+
+struct Result {
+  double airtime_ratio;
+  double spi_transactions;
+  double spi_bytes;
+  double cpu_us;
+};
+
+static double host_clock_us() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 1000.0;
+}
+
+static Result bench_transmit(uint8_t length) {
+  std::vector<uint8_t> frame(length, 0x55);
+  module.transmitted.clear();
+  module.spi_transactions = module.spi_bytes = 0;
+  uint64_t start_us = host_time_us;
+  double cpu = host_clock_us();
+
+  for (int sent = 0; sent < frames;) {
+    if (radio.transmit(frame.data(), length)) {
+      sent++;
+    } else {
+      SX1278Emulator::run(1000);
+    }
+  }
+  while (!radio.tx_fifo_empty() || module.mode() != 0b101) {
+    SX1278Emulator::run(1000);
+  }
+
+  double ideal_us = static_cast<double>(module.time_on_air(length)) * frames;
+  return {ideal_us / (module.transmitted.back().end_us - start_us),
+          static_cast<double>(module.spi_transactions) / frames,
+          static_cast<double>(module.spi_bytes) / frames,
+          (host_clock_us() - cpu) / frames};
+}
+
+static Result bench_receive(uint8_t length) {
+  std::vector<uint8_t> frame(length, 0xAA);
+  module.spi_transactions = module.spi_bytes = 0;
+  uint64_t start_us = host_time_us;
+  double cpu = host_clock_us();
+  uint8_t data[255], received_length;
+
+  for (int i = 0; i < frames; ++i) {
+    // back to back, as long as the module is listening
+    module.receive(frame);
+    SX1278Emulator::run(module.time_on_air(length));
+    while (radio.available()) {
+      radio.receive(data, received_length);
+    }
+  }
+
+  double ideal_us = static_cast<double>(module.time_on_air(length)) * frames;
+  return {ideal_us / (host_time_us - start_us),
+          static_cast<double>(module.spi_transactions) / frames,
+          static_cast<double>(module.spi_bytes) / frames,
+          (host_clock_us() - cpu) / frames};
+}
+
+// 30-byte telemetry messages sent as fast as possible, as separate frames or aggregated
+static double message_rate(bool aggregated) {
+  radio.set_config(Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8));
+  if (aggregated) {
+    radio.enable_aggregation(1000);
+  }
+  uint8_t message[30] = {};
+  uint64_t start_us = host_time_us;
+  for (int sent = 0; sent < frames;) {
+    if (radio.transmit(message, sizeof(message))) {
+      sent++;
+    } else {
+      SX1278Emulator::run(1000);
+    }
+    radio.poll();
+  }
+  radio.flush();
+  radio.disable_aggregation();
+  return frames * 1e6 / (host_time_us - start_us);
+}
+
+// 16-byte frames at 500 kHz sent as fast as possible
+static double frame_rate(const Radio::Config& fast) {
+  radio.set_config(fast);
+  uint8_t message[16] = {};
+  uint64_t start_us = host_time_us;
+  for (int sent = 0; sent < frames;) {
+    if (radio.transmit(message, sizeof(message))) {
+      sent++;
+    } else {
+      SX1278Emulator::run(1000);
+    }
+  }
+  radio.flush();
+  return frames * 1e6 / (host_time_us - start_us);
+}
+
+// ms from queueing an 8-byte event frame behind 8 housekeeping frames of 60 bytes (SF9) to the end of its transmission
+static double event_latency_ms(Radio::Priority priority) {
+  radio.set_config(Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8));
+  uint8_t housekeeping[60] = {};
+  for (int i = 0; i < 8; ++i) {
+    radio.transmit(housekeeping, sizeof(housekeeping));
+  }
+  module.transmitted.clear();
+  const uint8_t event[8] = {'E'};
+  uint64_t start_us = host_time_us;
+  radio.transmit(event, sizeof(event), priority);
+  radio.flush();
+  for (auto& packet : module.transmitted) {
+    if (packet.payload.size() == sizeof(event)) {
+      return (packet.end_us - start_us) / 1000.0;
+    }
+  }
+  return 0;
+}
+
+// mean age (ms) of 30-byte samples at the end of their transmission, sampled every 100 ms at SF9 for 60 s
+static double sample_age_ms(bool latest) {
+  radio.set_config(Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8));
+  module.transmitted.clear();
+  uint8_t sample[30] = {};
+  for (int i = 0; i < 600; ++i) {
+    uint32_t now = micros();
+    memcpy(sample, &now, sizeof(now));
+    if (latest) {
+      radio.transmit_latest(0, sample, sizeof(sample));
+    } else {
+      radio.transmit(sample, sizeof(sample));
+    }
+    SX1278Emulator::run(100000);
+  }
+  radio.flush();
+  double age = 0;
+  for (auto& packet : module.transmitted) {
+    uint32_t sampled;
+    memcpy(&sampled, packet.payload.data(), sizeof(sampled));
+    age += static_cast<uint32_t>(packet.end_us) - sampled;
+  }
+  return age / module.transmitted.size() / 1000;
+}
+
+// SPI transactions of a change of spreading factor and channel: re-initialisation (as set_config() did before) or retune()
+static unsigned retune_transactions(bool reinitialise) {
+  radio.set_config(Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8));
+  unsigned before = module.spi_transactions;
+  if (reinitialise) {
+    radio.begin();
+  } else {
+    radio.retune(Radio::Config(434.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8));
+  }
+  return module.spi_transactions - before;
+}
+
+enum class Access {
+  Any,
+  ListenBeforeTalk,
+  Tdma,
+};
+
+struct SharedChannel {
+  double sent;
+  double received;
+  unsigned collisions;
+  unsigned crc_errors;
+  unsigned busy;
+};
+
+// three CanSats sending 20-byte frames at random times (about 40 % channel load at SF7)
+// to one ground station for 60 s, at any time, with listen before talk or in TDMA slots
+static SharedChannel shared_channel(Access access) {
+  static constexpr Radio::Config config(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8);
+  static SX1278Emulator node_modules[3], ground_module;
+  // receive buffer for beacons only
+  static BasicRadio<4, 2> nodes[] = {{node_modules[0], config}, {node_modules[1], config}, {node_modules[2], config}};
+  static TdmaNode<BasicRadio<4, 2>> tdma_nodes[] = {{nodes[0], 1}, {nodes[1], 2}, {nodes[2], 3}};
+  static Radio ground(ground_module, config);
+  TdmaGround<> tdma_ground(ground, 3, 1, 20);
+  static bool connected = false;
+  if (!connected) {
+    for (int i = 0; i < 3; ++i) {
+      node_modules[i].connect(ground_module);
+      for (int j = i + 1; j < 3; ++j) {
+        node_modules[i].connect(node_modules[j]);
+      }
+    }
+    connected = true;
+  }
+  ground.disable_debug();
+  ground.set_config(config);
+  ground.reset_stats();
+  unsigned collisions = ground_module.collisions;
+  uint32_t next_frame_us[3], state = 1;
+  for (int i = 0; i < 3; ++i) {
+    nodes[i].disable_debug();
+    nodes[i].set_config(config);
+    nodes[i].reset_stats();
+    if (access == Access::ListenBeforeTalk) {
+      nodes[i].enable_listen_before_talk(100);
+    } else {
+      nodes[i].disable_listen_before_talk();
+    }
+    if (access == Access::Tdma) {
+      tdma_nodes[i].begin();
+    } else {
+      nodes[i].disable_tdma();
+    }
+    next_frame_us[i] = micros();
+  }
+  if (access == Access::Tdma) {
+    tdma_ground.begin();
+  } else {
+    ground.disable_tdma();
+  }
+
+  const uint8_t frame[20] = {};
+  // each node sends a frame of 78 ms airtime every 585 ms on average
+  constexpr uint32_t mean_interval_us = 3 * config.time_on_air(sizeof(frame)) * 100 / 40;
+  uint32_t received = 0;
+  uint64_t end_us = host_time_us + 60000000;
+  while (host_time_us < end_us) {
+    if (access == Access::Tdma) {
+      tdma_ground.poll();
+    }
+    for (int i = 0; i < 3; ++i) {
+      uint8_t data[255], length;
+      Radio::FrameInfo info;
+      while (nodes[i].available()) {
+        nodes[i].receive(data, length, info);
+        tdma_nodes[i].handle(data, length, info);
+      }
+      if (static_cast<int32_t>(micros() - next_frame_us[i]) >= 0) {
+        nodes[i].transmit(frame, sizeof(frame));
+        state = state * 1103515245u + 12345u;
+        next_frame_us[i] += (state >> 8) % (2 * mean_interval_us);
+      }
+      nodes[i].poll();
+    }
+    SX1278Emulator::run(1000);
+    uint8_t data[255], length;
+    while (ground.available()) {
+      ground.receive(data, length);
+      received++;
+    }
+  }
+  uint32_t sent = 0;
+  unsigned busy = 0;
+  for (auto& node : nodes) {
+    sent += node.stats().frames_sent;
+    busy += node.stats().channel_busy;
+  }
+  return {sent / 60.0, received / 60.0, ground_module.collisions - collisions, ground.stats().crc_errors, busy};
+}
+
+static void print(const char* direction, uint8_t length, const Result& result) {
+  std::printf("%-3s %4u B  airtime %6.2f %%  SPI %6.1f transactions %7.1f bytes  CPU %7.2f us/frame\n",
+              direction, length, result.airtime_ratio * 100, result.spi_transactions, result.spi_bytes,
+              result.cpu_us);
+}
+
+// non-empty log2 bins as "upper limit: count"
+static void print_histogram(const char* name, const uint32_t* histogram) {
+  std::printf("%s:", name);
+  for (int bin = 0; bin < Radio::histogram_bins; ++bin) {
+    if (histogram[bin] > 0) {
+      std::printf("  <%u us: %u", 1u << bin, histogram[bin]);
+    }
+  }
+  std::printf("\n");
+}
+
+int main() {
+  radio.disable_debug();
+  if (!radio.begin()) {
+    std::printf("begin() failed\n");
+    return 1;
+  }
+
+  radio.reset_stats();
+  for (uint8_t length : {8, 32, 128, 255}) {
+    print("TX", length, bench_transmit(length));
+  }
+  for (uint8_t length : {8, 32, 128, 255}) {
+    print("RX", length, bench_receive(length));
+  }
+  // SPI time is simulated at the SPI clock, the rest of the interrupt takes no time on the host
+  auto stats = radio.stats();
+  print_histogram("interrupt time", stats.interrupt_time);
+  print_histogram("TX gap between frames", stats.tx_gap);
+  std::printf("SF9 30 B messages: %.1f/s separate, %.1f/s aggregated\n", message_rate(false), message_rate(true));
+  std::printf("500 kHz 16 B frames: %.1f/s SF7, %.1f/s SF7 implicit header, %.1f/s SF6 implicit header\n",
+              frame_rate(Radio::Config(433.0, Bandwidth_500000_Hz, SpreadingFactor_7, CodingRate_4_5)),
+              frame_rate(Radio::Config(433.0, Bandwidth_500000_Hz, SpreadingFactor_7, CodingRate_4_5, 16)),
+              frame_rate(Radio::Config(433.0, Bandwidth_500000_Hz, SpreadingFactor_6, CodingRate_4_5, 16)));
+  std::printf("SF9 event frame behind 8 frames: %.0f ms normal, %.0f ms high priority\n",
+              event_latency_ms(Priority_Normal), event_latency_ms(Priority_High));
+  std::printf("SF9 samples every 100 ms, mean age on arrival: %.0f ms queued, %.0f ms latest value\n",
+              sample_age_ms(false), sample_age_ms(true));
+  std::printf("SF and channel change: %u SPI transactions begin(), %u retune()\n",
+              retune_transactions(true), retune_transactions(false));
+  for (auto access : {Access::Any, Access::ListenBeforeTalk, Access::Tdma}) {
+    static const char* const names[] = {"any time", "listen before talk", "TDMA slots"};
+    auto shared = shared_channel(access);
+    std::printf("3 CanSats, one ground station, %s: %.1f of %.1f frames/s received, %u collisions, %u CRC errors, %u backoffs\n",
+                names[static_cast<int>(access)], shared.received, shared.sent, shared.collisions,
+                shared.crc_errors, shared.busy);
+  }
+  return 0;
+}
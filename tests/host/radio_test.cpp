@@ -0,0 +1,1037 @@
+// Radio driven against the SX1278 emulator.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc -Itests/host tests/host/radio_test.cpp tests/host/sx1278_emulator.cpp
+//     tests/host/arduino.cpp src/CanSatKitRadio*.cpp -o radio_test && ./radio_test
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "CanSatKit.h"
+#include "SPI.h"
+#include "host_test.h"
+#include "sx1278_emulator.h"
+
+using namespace CanSatKit;
+
+static SX1278Emulator module;
+static constexpr Radio::Config config(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8);
+static Radio radio(module, config);
+
+constexpr uint8_t MODE_STANDBY = 0b001;
+constexpr uint8_t MODE_RXCONTINUOUS = 0b101;
+
+static std::vector<uint8_t> bytes(const char* str) {
+  return std::vector<uint8_t>(str, str + strlen(str) + 1);
+}
+
+// let the radio send everything and go back to RX
+static void run_until_idle() {
+  for (int i = 0; i < 1000 && (!radio.tx_fifo_empty() || module.mode() != MODE_RXCONTINUOUS); ++i) {
+    SX1278Emulator::run(10000);
+  }
+}
+
+static void begin_configures_module() {
+  CHECK(radio.begin());
+  // 433 MHz
+  CHECK(module.reg(0x06) == 0x6C && module.reg(0x07) == 0x40 && module.reg(0x08) == 0x00);
+  // LoRa, LF registers
+  CHECK((module.reg(0x01) & 0b11111000) == 0b10001000);
+  // 125 kHz, 4/8, explicit header; SF7, CRC on
+  CHECK(module.reg(0x1D) == 0b01111000);
+  CHECK(module.reg(0x1E) == 0b01110100);
+  CHECK(module.mode() == MODE_RXCONTINUOUS);
+  CHECK(radio.verify_registers());
+}
+
+static void begin_fails_without_module() {
+  module.present = false;
+  bool ok = radio.begin();
+  module.present = true;
+  CHECK(!ok);
+  CHECK(radio.begin());
+}
+
+static void transmit_string() {
+  module.transmitted.clear();
+  CHECK(radio.transmit("Hello CanSat!"));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 1);
+  CHECK(module.transmitted[0].payload == bytes("Hello CanSat!"));
+  CHECK(module.transmitted[0].end_us - module.transmitted[0].start_us == module.time_on_air(14));
+}
+
+static void transmit_frame_in_place() {
+  module.transmitted.clear();
+  {
+    TransmitFrame frame(radio);
+    CHECK(frame.valid());
+    frame.print(187);
+    frame.print(" tester");
+    // only one frame can be reserved at a time
+    CHECK(!radio.transmit("foo"));
+    CHECK(frame.send());
+  }
+  {
+    // dropped without send()
+    TransmitFrame frame(radio);
+    frame.print("dropped");
+  }
+  CHECK(radio.transmit("bar"));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 2);
+  CHECK(module.transmitted[0].payload == bytes("187 tester"));
+  CHECK(module.transmitted[1].payload == bytes("bar"));
+}
+
+static void fill_transmit_buffer() {
+  module.transmitted.clear();
+  uint8_t buffer[255];
+  for (int i = 0; i < 255; ++i) {
+    buffer[i] = i;
+  }
+  // one frame goes directly to the radio module, 10 frames to the buffer
+  for (int i = 0; i < 11; ++i) {
+    buffer[0] = i;
+    CHECK(radio.transmit(buffer, 255));
+  }
+  CHECK(!radio.transmit(buffer, 255));
+  CHECK(!radio.transmit(buffer, 0));
+
+  run_until_idle();
+  CHECK(module.transmitted.size() == 11);
+  for (int i = 0; i < 11; ++i) {
+    CHECK(module.transmitted[i].payload.size() == 255);
+    CHECK(module.transmitted[i].payload[0] == i);
+    CHECK(module.transmitted[i].payload[254] == 254);
+  }
+  // frames are sent back to back
+  for (int i = 1; i < 11; ++i) {
+    CHECK(module.transmitted[i].start_us - module.transmitted[i - 1].end_us < 2000);
+  }
+  CHECK(module.mode() == MODE_RXCONTINUOUS);
+}
+
+static void receive_frames() {
+  module.receive(bytes("test 123"));
+  CHECK(radio.available() == 0);
+  SX1278Emulator::run(module.time_on_air(9));
+  CHECK(radio.available() == 1);
+
+  char data[256];
+  radio.receive(data);
+  CHECK(std::string(data) == "test 123");
+  CHECK(radio.available() == 0);
+
+  module.receive({1, 2, 3}, -80);
+  SX1278Emulator::run(100000);
+  uint8_t length;
+  const uint8_t* frame = radio.peek(length);
+  CHECK(frame != nullptr);
+  CHECK(length == 3 && frame[0] == 1 && frame[2] == 3);
+  // still there until released
+  CHECK(radio.peek(length) == frame);
+  CHECK(radio.get_rssi_last() == -80);
+  radio.release();
+  CHECK(radio.peek(length) == nullptr);
+
+  module.receive({1}, -120, -7.25f);
+  SX1278Emulator::run(100000);
+  radio.release();
+  CHECK(radio.get_snr_last() == -7.25f);
+}
+
+static void receive_and_flush_with_timeout() {
+  uint8_t data[255];
+  uint8_t length;
+  Radio::FrameInfo info;
+  CHECK(!radio.try_receive(data, length));
+  uint64_t start = host_time_us;
+  CHECK(!radio.receive(data, length, 50));
+  // millis() resolution
+  CHECK(host_time_us - start >= 49000 && host_time_us - start <= 51000);
+
+  module.receive({4, 5}, -70);
+  CHECK(radio.receive(data, length, info, 1000));
+  CHECK(length == 2 && data[1] == 5 && info.rssi == -70);
+  CHECK(!radio.try_receive(data, length, info));
+
+  CHECK(radio.transmit(data, 200));
+  CHECK(!radio.flush(10));
+  CHECK(radio.flush(1000));
+}
+
+static std::vector<std::vector<uint8_t>> callback_frames;
+static int transmit_done_calls = 0;
+
+static void store_frame(const uint8_t* data, uint8_t length, const Radio::FrameInfo&) {
+  callback_frames.emplace_back(data, data + length);
+}
+
+static void count_transmit_done() {
+  transmit_done_calls++;
+}
+
+static void callbacks_from_poll() {
+  radio.on_receive(store_frame);
+  radio.on_transmit_done(count_transmit_done);
+  module.receive({1});
+  SX1278Emulator::run(100000);
+  module.receive({2, 3});
+  SX1278Emulator::run(100000);
+  CHECK(callback_frames.empty());
+  radio.poll();
+  CHECK(callback_frames.size() == 2);
+  CHECK(callback_frames[1] == std::vector<uint8_t>({2, 3}));
+  CHECK(radio.available() == 0);
+
+  uint8_t data[10] = {};
+  radio.transmit(data, 10);
+  radio.transmit(data, 10);
+  radio.poll();
+  CHECK(transmit_done_calls == 0);
+  SX1278Emulator::run(1000000);
+  radio.poll();
+  radio.poll();
+  CHECK(transmit_done_calls == 1);
+
+  radio.on_receive(nullptr);
+  radio.on_transmit_done(nullptr);
+  module.receive({1});
+  SX1278Emulator::run(100000);
+  radio.poll();
+  CHECK(callback_frames.size() == 2);
+  CHECK(radio.available() == 1);
+  radio.release();
+}
+
+static void frame_info_of_each_frame() {
+  // all three frames are waiting before the first one is read
+  const int rssi[] = {-70, -100, -125};
+  const float snr[] = {9.0f, 2.5f, -8.75f};
+  const int32_t frequency_error[] = {0, 1500, -2200};
+  uint32_t end_us[3];
+  for (int i = 0; i < 3; ++i) {
+    module.receive({static_cast<uint8_t>(i)}, rssi[i], snr[i], true, frequency_error[i]);
+    SX1278Emulator::run(module.time_on_air(1) + 1000);
+    end_us[i] = static_cast<uint32_t>(host_time_us);
+  }
+  CHECK(radio.available() == 3);
+  CHECK(radio.get_rssi_last() == -125 - 8);
+
+  for (int i = 0; i < 3; ++i) {
+    uint8_t data[255], length;
+    Radio::FrameInfo info;
+    radio.receive(data, length, info);
+    CHECK(length == 1 && data[0] == i);
+    // below the noise floor RSSI is corrected with SNR
+    CHECK(info.rssi == (snr[i] < 0 ? rssi[i] + static_cast<int>(snr[i]) : rssi[i]));
+    CHECK(info.snr == snr[i]);
+    // FEI step is about 4 Hz at 125 kHz
+    CHECK(std::abs(info.frequency_error - frequency_error[i]) < 10);
+    CHECK(info.time_us <= end_us[i] && end_us[i] - info.time_us < 1000);
+  }
+}
+
+static void crc_errors_are_dropped() {
+  module.receive(bytes("broken"), -60, 9.0f, false);
+  SX1278Emulator::run(100000);
+  CHECK(radio.available() == 0);
+
+  // next frame is read from its own place in the module FIFO
+  module.receive(bytes("fine"));
+  SX1278Emulator::run(100000);
+  char text[256];
+  CHECK(radio.available() == 1);
+  radio.receive(text);
+  CHECK(std::string(text) == "fine");
+}
+
+static void interrupt_debug_messages_are_deferred() {
+  radio.enable_debug();
+  SerialUSB.output.clear();
+  module.receive(bytes("broken"), -60, 9.0f, false);
+  SX1278Emulator::run(100000);
+  // nothing printed inside the interrupt
+  CHECK(SerialUSB.output.empty());
+
+  radio.poll();
+  CHECK(SerialUSB.output.find("us CRC fail! (7 B frame)") != std::string::npos);
+  SerialUSB.output.clear();
+  radio.poll();
+  CHECK(SerialUSB.output.empty());
+  radio.disable_debug();
+}
+
+static void receive_buffer_overflow() {
+  std::vector<uint8_t> frame(255);
+  for (int i = 0; i < 11; ++i) {
+    frame[0] = i;
+    module.receive(frame);
+    SX1278Emulator::run(module.time_on_air(255) + 100);
+  }
+  // 10 frames fit, last one dropped
+  CHECK(radio.available() == 10);
+  for (int i = 0; i < 10; ++i) {
+    uint8_t data[255], length;
+    radio.receive(data, length);
+    CHECK(length == 255 && data[0] == i);
+  }
+  CHECK(radio.available() == 0);
+}
+
+// link status is kept with each frame, so short frames are limited only by the buffer size
+static void receive_many_short_frames() {
+  uint32_t overflows = radio.stats().rx_overflows;
+  for (int i = 0; i < 150; ++i) {
+    module.receive({static_cast<uint8_t>(i)}, -60 - i % 50);
+    SX1278Emulator::run(module.time_on_air(1) + 100);
+  }
+  CHECK(radio.available() == 150);
+  CHECK(radio.stats().rx_overflows == overflows);
+  for (int i = 0; i < 150; ++i) {
+    uint8_t data[255], length;
+    Radio::FrameInfo info;
+    radio.receive(data, length, info);
+    CHECK(length == 1 && data[0] == i && info.rssi == -60 - i % 50);
+  }
+  CHECK(radio.available() == 0);
+}
+
+static void receive_while_transmitting_is_missed() {
+  module.missed = 0;
+  CHECK(radio.transmit("busy"));
+  module.receive(bytes("lost"));
+  run_until_idle();
+  CHECK(module.missed == 1);
+  CHECK(radio.available() == 0);
+}
+
+// SF7 at 125 kHz: 1.024 ms symbols, 12.25 symbols of preamble, 14 bytes -> 8 + 5 * 8 symbols
+static_assert(config.time_on_air(14) == 61696, "time on air");
+static_assert(!config.low_data_rate_optimize(), "symbols shorter than 16 ms");
+static_assert(Radio::low_data_rate_optimize(Bandwidth_125000_Hz, SpreadingFactor_11), "symbols longer than 16 ms");
+// SF6 at 500 kHz: 0.128 ms symbols, 16 bytes without header -> 8 + 6 * 5 symbols
+static_assert(Radio::time_on_air(Bandwidth_500000_Hz, SpreadingFactor_6, CodingRate_4_5, 16, true) == 6432, "time on air");
+// SF7: header takes 5 symbols (one block of 4/5)
+static_assert(Radio::time_on_air(Bandwidth_500000_Hz, SpreadingFactor_7, CodingRate_4_5, 16) == 12864, "time on air");
+static_assert(Radio::Config(433.0, Bandwidth_500000_Hz, SpreadingFactor_7, CodingRate_4_5, 16).time_on_air(16) == 11584, "time on air");
+
+static void time_on_air_matches_module() {
+  const Radio::Config configs[] = {
+    Radio::Config(433.0, Bandwidth_500000_Hz, SpreadingFactor_7, CodingRate_4_5),
+    Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8),
+    Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_11, CodingRate_4_6),
+    Radio::Config(433.0, Bandwidth_62500_Hz, SpreadingFactor_10, CodingRate_4_7),
+    Radio::Config(433.0, Bandwidth_7800_Hz, SpreadingFactor_12, CodingRate_4_8),
+    Radio::Config(433.0, Bandwidth_500000_Hz, SpreadingFactor_6, CodingRate_4_5, 255),
+    Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_8, CodingRate_4_6, 32),
+  };
+  for (auto& other : configs) {
+    radio.set_config(other);
+    // low data rate optimisation chosen from symbol time
+    CHECK(((module.reg(0x26) & 0b1000) != 0) == other.low_data_rate_optimize());
+    for (int length : {1, 10, 100, 255}) {
+      CHECK(radio.time_on_air(length) == module.time_on_air(length));
+    }
+  }
+  radio.set_config(config);
+  CHECK((module.reg(0x26) & 0b1000) == 0);
+}
+
+static void implicit_header_and_sf6() {
+  // SF6 works only without header
+  CHECK(!radio.set_config(Radio::Config(433.0, Bandwidth_500000_Hz, SpreadingFactor_6, CodingRate_4_5)));
+
+  constexpr Radio::Config fixed(433.0, Bandwidth_500000_Hz, SpreadingFactor_6, CodingRate_4_5, 16);
+  radio.set_config(fixed);
+  // implicit header, SF6, frame length and SF6 detection settings
+  CHECK((module.reg(0x1D) & 0b1) == 1);
+  CHECK((module.reg(0x1E) >> 4) == 6);
+  CHECK(module.reg(0x22) == 16);
+  CHECK((module.reg(0x31) & 0b111) == 0b101);
+  CHECK(module.reg(0x37) == 0x0C);
+  CHECK(radio.verify_registers());
+
+  // shorter frames are padded, longer ones do not fit
+  module.transmitted.clear();
+  CHECK(radio.max_frame_length() == 16);
+  CHECK(!radio.reserve(17));
+  CHECK(radio.transmit("fixed"));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 1);
+  std::vector<uint8_t> expected = bytes("fixed");
+  expected.resize(16);
+  CHECK(module.transmitted[0].payload == expected);
+  CHECK(module.transmitted[0].end_us - module.transmitted[0].start_us == fixed.time_on_air(16));
+
+  // received frames have the configured length
+  module.receive(expected);
+  run_until_idle();
+  SX1278Emulator::run(fixed.time_on_air(16));
+  CHECK(radio.available() == 1);
+  uint8_t data[255];
+  uint8_t length;
+  radio.receive(data, length);
+  CHECK(length == 16 && std::vector<uint8_t>(data, data + length) == expected);
+
+  // messages cannot be aggregated into frames of fixed length
+  radio.enable_aggregation(100);
+  CHECK(radio.max_frame_length() == 16);
+
+  radio.set_config(config);
+  CHECK(radio.max_frame_length() == 255);
+}
+
+static void set_config_while_running() {
+  module.receive({1, 2, 3});
+  SX1278Emulator::run(100000);
+  module.transmitted.clear();
+  CHECK(radio.transmit("before"));
+
+  constexpr Radio::Config slow(433.0, Bandwidth_250000_Hz, SpreadingFactor_9, CodingRate_4_8);
+  CHECK(radio.set_config(slow));
+  // queued frame is sent with old settings first
+  CHECK(module.transmitted.size() == 1);
+  CHECK(module.transmitted[0].end_us - module.transmitted[0].start_us == config.time_on_air(7));
+  CHECK((module.reg(0x1D) >> 4) == 0b1000);
+  CHECK((module.reg(0x1E) >> 4) == 9);
+  CHECK(radio.get_config().spreadingFactor == SpreadingFactor_9);
+  CHECK(radio.time_on_air(10) == slow.time_on_air(10));
+  CHECK(radio.verify_registers());
+  CHECK(module.mode() == MODE_RXCONTINUOUS);
+  // received frames are kept
+  CHECK(radio.available() == 1);
+  radio.release();
+
+  CHECK(radio.set_config(config));
+  CHECK(radio.time_on_air(10) == config.time_on_air(10));
+}
+
+static void retune_with_queued_frames() {
+  run_until_idle();
+  // in receive mode: standby, frequency registers, back to RX
+  unsigned transactions = module.spi_transactions;
+  CHECK(radio.set_frequency(434.0));
+  CHECK(module.spi_transactions - transactions == 3);
+  CHECK(module.reg(0x06) == 0x6C && module.reg(0x07) == 0x80);
+  CHECK(module.mode() == MODE_RXCONTINUOUS);
+  // nothing changes
+  transactions = module.spi_transactions;
+  CHECK(radio.set_frequency(434.0));
+  CHECK(module.spi_transactions - transactions == 2);
+
+  // the frame on air is finished, waiting ones go with new settings
+  module.transmitted.clear();
+  uint8_t data[50] = {};
+  for (int i = 0; i < 3; ++i) {
+    CHECK(radio.transmit(data, sizeof(data)));
+  }
+  CHECK(radio.set_modem(Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8));
+  CHECK(radio.get_config().spreadingFactor == SpreadingFactor_9);
+  constexpr Radio::Config slow(434.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8);
+  CHECK(radio.tx_queue_time() == 2 * slow.time_on_air(sizeof(data)));
+  radio.flush();
+  CHECK(module.transmitted.size() == 3);
+  CHECK(module.transmitted[0].end_us - module.transmitted[0].start_us == config.time_on_air(sizeof(data)));
+  CHECK(module.transmitted[1].end_us - module.transmitted[1].start_us == slow.time_on_air(sizeof(data)));
+  CHECK(module.transmitted[2].end_us - module.transmitted[2].start_us == slow.time_on_air(sizeof(data)));
+  CHECK(radio.tx_queue_time() == 0);
+  CHECK(radio.verify_registers());
+
+  // SF6 needs implicit header, settings stay
+  CHECK(!radio.set_modem(Bandwidth_500000_Hz, SpreadingFactor_6, CodingRate_4_5));
+  CHECK(radio.get_config().spreadingFactor == SpreadingFactor_9);
+
+  CHECK(radio.retune(config));
+  CHECK(module.reg(0x07) == 0x40);
+  CHECK(radio.verify_registers());
+}
+
+// TX_DONE of the last frame with old settings is pending while modem registers are written
+static unsigned writes_with_time_run, frames_started_in_retune;
+
+static void run_during_modem_config_2(uint8_t reg) {
+  if (reg == 0x1E) {
+    writes_with_time_run++;
+    size_t sent = module.transmitted.size();
+    SX1278Emulator::run(1000);
+    if (module.transmitted.size() != sent || module.mode() != MODE_STANDBY) {
+      frames_started_in_retune++;
+    }
+  }
+}
+
+static void retune_holds_interrupt() {
+  run_until_idle();
+  module.transmitted.clear();
+  uint8_t data[50] = {};
+  for (int i = 0; i < 3; ++i) {
+    CHECK(radio.transmit(data, sizeof(data)));
+  }
+  module.on_write = run_during_modem_config_2;
+  CHECK(radio.set_modem(Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8));
+  module.on_write = nullptr;
+  CHECK(writes_with_time_run == 1);
+  CHECK(frames_started_in_retune == 0);
+  radio.flush();
+  constexpr Radio::Config slow(433.0, Bandwidth_125000_Hz, SpreadingFactor_9, CodingRate_4_8);
+  CHECK(module.transmitted.size() == 3);
+  CHECK(module.transmitted[1].end_us - module.transmitted[1].start_us == slow.time_on_air(sizeof(data)));
+  CHECK(module.transmitted[2].end_us - module.transmitted[2].start_us == slow.time_on_air(sizeof(data)));
+  CHECK(radio.retune(config));
+  CHECK(radio.verify_registers());
+}
+
+// frames are padded to the implicit header length they were reserved with, it does not change under them
+static void retune_implicit_header_with_reserved_frame() {
+  run_until_idle();
+  module.transmitted.clear();
+  constexpr Radio::Config fixed(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8, 16);
+  auto frame = radio.reserve(5);
+  CHECK(frame != nullptr);
+  memcpy(frame, "short", 5);
+  CHECK(!radio.retune(fixed));
+  CHECK(radio.get_config().implicit_header_length == 0);
+  CHECK(radio.commit(5));
+  // first frame is on air, the next one waits
+  CHECK(radio.transmit("waiting"));
+  CHECK(!radio.retune(fixed));
+  radio.flush();
+  CHECK(module.transmitted.size() == 2);
+  CHECK(module.transmitted[0].payload == std::vector<uint8_t>({'s', 'h', 'o', 'r', 't'}));
+  CHECK(module.transmitted[1].payload == bytes("waiting"));
+  CHECK(radio.retune(fixed));
+  CHECK(module.reg(0x22) == 16);
+  CHECK(radio.retune(config));
+  CHECK(radio.verify_registers());
+}
+
+static void listen_before_talk() {
+  run_until_idle();
+  radio.enable_listen_before_talk(50);
+  radio.reset_stats();
+  module.transmitted.clear();
+
+  // free channel: channel activity detection (two symbols of 1.024 ms) before the frame
+  uint64_t start_us = host_time_us;
+  CHECK(radio.transmit("free"));
+  radio.flush();
+  CHECK(module.transmitted.size() == 1);
+  CHECK(module.transmitted[0].start_us - start_us >= 2048);
+  CHECK(radio.stats().channel_busy == 0);
+
+  // another CanSat on air: listen until it ends
+  std::vector<uint8_t> other(100, 'x');
+  module.receive(other);
+  uint64_t other_end_us = host_time_us + module.time_on_air(other.size());
+  CHECK(radio.transmit("busy"));
+  SX1278Emulator::run(5000);
+  CHECK(radio.stats().channel_busy == 1);
+  CHECK(module.mode() == MODE_RXCONTINUOUS);
+  CHECK(!radio.tx_fifo_empty());
+  radio.flush();
+  CHECK(module.transmitted.size() == 2 && module.transmitted[1].payload == bytes("busy"));
+  CHECK(module.transmitted[1].start_us >= other_end_us);
+
+  // a frame waiting for the end of a backoff goes right away
+  module.receive(other);
+  CHECK(radio.transmit("now"));
+  SX1278Emulator::run(5000);
+  CHECK(module.transmitted.size() == 2);
+  radio.disable_listen_before_talk();
+  CHECK(module.transmitted.size() == 3);
+  run_until_idle();
+  CHECK(radio.verify_registers());
+}
+
+static void back_to_back_frames() {
+  uint8_t data[20] = {1};
+  module.transmitted.clear();
+  for (int i = 0; i < 3; ++i) {
+    CHECK(radio.transmit(data, 20));
+  }
+  CHECK(radio.transmit(data, 5));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 4);
+  CHECK(module.transmitted[2].payload.size() == 20);
+  CHECK(module.transmitted[3].payload.size() == 5 && module.transmitted[3].payload[0] == 1);
+  // only the frame upload between frames: address pointer, FIFO, mode and IRQ flags
+  // (27 bytes for 20 B frames, 108 us at 2 MHz SPI)
+  for (size_t i = 1; i < module.transmitted.size(); ++i) {
+    CHECK(module.transmitted[i].start_us - module.transmitted[i - 1].end_us <= 110);
+  }
+}
+
+static void high_priority_goes_first() {
+  module.transmitted.clear();
+  uint8_t data[50] = {};
+  // first one goes to the module right away
+  for (int i = 0; i < 4; ++i) {
+    data[0] = i;
+    CHECK(radio.transmit(data, sizeof(data), Priority_Low));
+  }
+  data[0] = 10;
+  CHECK(radio.transmit(data, sizeof(data)));
+  data[0] = 20;
+  CHECK(radio.transmit(data, sizeof(data), Priority_High));
+  {
+    TransmitFrame frame(radio, Priority_High);
+    frame.print("event");
+    CHECK(frame.send());
+  }
+  run_until_idle();
+  std::vector<uint8_t> order;
+  for (auto& packet : module.transmitted) {
+    order.push_back(packet.payload[0]);
+  }
+  CHECK(order == std::vector<uint8_t>({0, 20, 'e', 10, 1, 2, 3}));
+
+  // own buffer space of each priority
+  uint8_t frame[255] = {};
+  int low = 0;
+  while (radio.transmit(frame, sizeof(frame), Priority_Low)) {
+    low++;
+  }
+  CHECK(low >= 2);
+  CHECK(radio.transmit(frame, sizeof(frame)));
+  CHECK(radio.transmit(frame, sizeof(frame), Priority_High));
+  run_until_idle();
+}
+
+static void priority_aging() {
+  radio.set_priority_aging(2);
+  module.transmitted.clear();
+  uint8_t data[50] = {};
+  data[0] = 1;
+  CHECK(radio.transmit(data, sizeof(data)));
+  data[0] = 2;
+  CHECK(radio.transmit(data, sizeof(data), Priority_Low));
+  for (int i = 0; i < 5; ++i) {
+    data[0] = 10 + i;
+    CHECK(radio.transmit(data, sizeof(data), Priority_Normal));
+  }
+  run_until_idle();
+  std::vector<uint8_t> order;
+  for (auto& packet : module.transmitted) {
+    order.push_back(packet.payload[0]);
+  }
+  // low waits for 2 normal frames only
+  CHECK(order == std::vector<uint8_t>({1, 10, 11, 2, 12, 13, 14}));
+  radio.set_priority_aging(0);
+}
+
+static void latest_value_replaces_waiting_frame() {
+  module.transmitted.clear();
+  radio.reset_stats();
+  uint8_t sample[20] = {};
+  // first one goes to the module right away
+  for (int i = 0; i < 5; ++i) {
+    sample[0] = i;
+    CHECK(radio.transmit_latest(1, sample, sizeof(sample)));
+    sample[0] = 100 + i;
+    CHECK(radio.transmit_latest(2, sample, sizeof(sample)));
+  }
+  // other length is queued
+  CHECK(radio.transmit_latest(2, sample, 10));
+  CHECK(!radio.transmit_latest(Radio::latest_keys, sample, sizeof(sample)));
+  run_until_idle();
+  std::vector<uint8_t> order;
+  for (auto& packet : module.transmitted) {
+    order.push_back(packet.payload[0]);
+  }
+  CHECK(order == std::vector<uint8_t>({0, 104, 4, 104}));
+  // key 1: frame 0 was on air already, 1 queued, 2-4 replaced; key 2: 1-4 replaced
+  CHECK(radio.stats().tx_replaced == 7);
+
+  // sent frame is not changed anymore
+  sample[0] = 50;
+  CHECK(radio.transmit_latest(1, sample, sizeof(sample)));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 5 && module.transmitted[4].payload[0] == 50);
+
+  // the same with aggregation: message replaced in the container
+  module.transmitted.clear();
+  radio.enable_aggregation(100);
+  sample[0] = 1;
+  CHECK(radio.transmit_latest(3, sample, 5));
+  CHECK(radio.transmit("other"));
+  sample[0] = 2;
+  CHECK(radio.transmit_latest(3, sample, 5));
+  radio.flush();
+  run_until_idle();
+  CHECK(module.transmitted.size() == 1);
+  std::vector<uint8_t> expected = {5, 2, 0, 0, 0, 0, 6, 'o', 't', 'h', 'e', 'r', 0};
+  CHECK(module.transmitted[0].payload == expected);
+  radio.disable_aggregation();
+}
+
+static void drop_oldest_when_full() {
+  module.transmitted.clear();
+  radio.reset_stats();
+  radio.set_drop_oldest(true);
+  uint8_t frame[255] = {};
+  for (int i = 0; i < 15; ++i) {
+    frame[0] = i;
+    CHECK(radio.transmit(frame, sizeof(frame)));
+  }
+  auto stats = radio.stats();
+  CHECK(stats.tx_full == 0 && stats.tx_dropped == 4);
+  // airtime of dropped frames is not counted anymore
+  CHECK(radio.tx_queue_time() <= 11 * radio.time_on_air(255));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 11);
+  // first one was on air already, the newest ones kept
+  CHECK(module.transmitted[0].payload[0] == 0);
+  CHECK(module.transmitted[1].payload[0] == 5);
+  CHECK(module.transmitted[10].payload[0] == 14);
+  CHECK(radio.tx_queue_time() == 0);
+  radio.set_drop_oldest(false);
+}
+
+static void tx_queue_time_follows_transmission() {
+  CHECK(radio.tx_queue_time() == 0);
+  CHECK(radio.transmit_delay(100) == radio.time_on_air(100));
+
+  uint8_t data[100] = {};
+  for (int i = 0; i < 3; ++i) {
+    CHECK(radio.transmit(data, sizeof(data)));
+  }
+  // first frame is on air already, SPI transfers between frames take a little time
+  uint32_t airtime = radio.time_on_air(sizeof(data));
+  CHECK(std::abs(static_cast<int>(radio.tx_queue_time() - 3 * airtime)) < 1000);
+  CHECK(radio.transmit_delay(10) == radio.tx_queue_time() + radio.time_on_air(10));
+
+  SX1278Emulator::run(airtime + airtime / 2);
+  CHECK(std::abs(static_cast<int>(radio.tx_queue_time() - 3 * airtime / 2)) < 1000);
+
+  run_until_idle();
+  CHECK(radio.tx_queue_time() == 0);
+}
+
+static void aggregation_packs_messages() {
+  module.transmitted.clear();
+  radio.enable_aggregation(100);
+  CHECK(radio.max_frame_length() == 254);
+  CHECK(radio.transmit("first"));
+  CHECK(radio.transmit("second"));
+  CHECK(radio.transmit("third"));
+  // not sent before the deadline
+  SX1278Emulator::run(50000);
+  radio.poll();
+  CHECK(module.transmitted.empty());
+  CHECK(!radio.tx_fifo_empty());
+  SX1278Emulator::run(50000);
+  radio.poll();
+  run_until_idle();
+  CHECK(module.transmitted.size() == 1);
+  std::vector<uint8_t> expected = {6, 'f', 'i', 'r', 's', 't', 0, 7, 's', 'e', 'c', 'o', 'n', 'd', 0, 6, 't', 'h', 'i', 'r', 'd', 0};
+  CHECK(module.transmitted[0].payload == expected);
+
+  // full frames are sent right away
+  module.transmitted.clear();
+  uint8_t data[100] = {};
+  for (int i = 0; i < 5; ++i) {
+    CHECK(radio.transmit(data, sizeof(data)));
+  }
+  CHECK(!radio.transmit(data, 255));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 2);
+  CHECK(module.transmitted[0].payload.size() == 2 * 101);
+  CHECK(module.transmitted[1].payload.size() == 2 * 101);
+  radio.flush();
+  run_until_idle();
+  CHECK(module.transmitted.size() == 3);
+  CHECK(module.transmitted[2].payload.size() == 101);
+  CHECK(radio.tx_fifo_empty());
+
+  // TransmitFrame needs the whole frame, waiting messages are sent first
+  module.transmitted.clear();
+  CHECK(radio.transmit("before"));
+  {
+    TransmitFrame frame(radio);
+    CHECK(frame.valid());
+    frame.print("in place");
+    CHECK(frame.send());
+  }
+  radio.flush();
+  run_until_idle();
+  CHECK(module.transmitted.size() == 2);
+  CHECK(module.transmitted[1].payload.size() == 10);
+
+  // high priority is not delayed, messages of other priority are not put in the same frame
+  module.transmitted.clear();
+  CHECK(radio.transmit("slow"));
+  CHECK(radio.transmit("urgent", Priority_High));
+  run_until_idle();
+  CHECK(module.transmitted.size() == 2);
+  expected = {7, 'u', 'r', 'g', 'e', 'n', 't', 0};
+  CHECK(module.transmitted[1].payload == expected);
+
+  // message after the deadline sends the frame, callbacks wait for poll()
+  module.transmitted.clear();
+  size_t callbacks = callback_frames.size();
+  radio.on_receive(store_frame);
+  CHECK(radio.transmit("late"));
+  module.receive({1, 'x'});
+  SX1278Emulator::run(100000);
+  CHECK(radio.transmit("deadline"));
+  CHECK(callback_frames.size() == callbacks);
+  run_until_idle();
+  CHECK(module.transmitted.size() == 1);
+  radio.poll();
+  CHECK(callback_frames.size() == callbacks + 1);
+  radio.on_receive(nullptr);
+
+  radio.disable_aggregation();
+  CHECK(radio.max_frame_length() == 255);
+}
+
+static void aggregation_splits_received_frames() {
+  radio.enable_aggregation(100);
+  module.receive({3, 'a', 'b', 0, 1, 'x', 2, 'c', 0});
+  SX1278Emulator::run(100000);
+  CHECK(radio.available() == 3);
+  char text[256];
+  radio.receive(text);
+  CHECK(std::string(text) == "ab");
+  uint8_t data[255], length;
+  radio.receive(data, length);
+  CHECK(length == 1 && data[0] == 'x');
+  radio.receive(text);
+  CHECK(std::string(text) == "c");
+
+  // messages share link quality of the frame
+  module.receive({1, 'y', 1, 'z'}, -90);
+  SX1278Emulator::run(100000);
+  Radio::FrameInfo info;
+  CHECK(radio.peek(length, info) && info.rssi == -90);
+  radio.release();
+  CHECK(radio.peek(length, info) && info.rssi == -90);
+  radio.release();
+  CHECK(radio.available() == 0);
+  module.receive({1, 'w'}, -50);
+  SX1278Emulator::run(100000);
+  CHECK(radio.peek(length, info) && info.rssi == -50);
+  radio.release();
+
+  // malformed frame is dropped
+  module.receive({5, 'a', 'b'});
+  SX1278Emulator::run(100000);
+  CHECK(radio.available() == 0);
+  radio.disable_aggregation();
+}
+
+static uint32_t histogram_total(const uint32_t* histogram) {
+  uint32_t total = 0;
+  for (int bin = 0; bin < Radio::histogram_bins; ++bin) {
+    total += histogram[bin];
+  }
+  return total;
+}
+
+static void stats_count_traffic() {
+  radio.reset_stats();
+  uint8_t data[255] = {};
+  for (int i = 0; i < 3; ++i) {
+    CHECK(radio.transmit(data, 100));
+  }
+  run_until_idle();
+  auto stats = radio.stats();
+  CHECK(stats.frames_sent == 3 && stats.bytes_sent == 300);
+  // RX -> TX -> RX
+  CHECK(stats.mode_switches == 2);
+  CHECK(stats.tx_frames_max == 2);
+  // gaps between 3 frames: interrupt writes 100 bytes to the module (about 400 us at 2 MHz SPI)
+  CHECK(histogram_total(stats.tx_gap) == 2);
+  CHECK(stats.tx_gap[9] == 2);
+  // 3 frames started, the last interrupt switches to RX
+  CHECK(histogram_total(stats.interrupt_time) == 4);
+
+  module.receive({1, 2, 3});
+  SX1278Emulator::run(100000);
+  module.receive({1, 2}, -60, 9.0f, false);
+  SX1278Emulator::run(100000);
+  stats = radio.stats();
+  CHECK(stats.frames_received == 1 && stats.bytes_received == 3);
+  CHECK(stats.crc_errors == 1);
+  CHECK(stats.rx_frames_max == 1);
+  radio.release();
+
+  // 11 frames do not fit in the transmit buffer (one goes to the module directly)
+  for (int i = 0; i < 12; ++i) {
+    radio.transmit(data, 255);
+  }
+  // nor in the receive buffer
+  radio.flush();
+  for (int i = 0; i < 11; ++i) {
+    module.receive(std::vector<uint8_t>(255));
+    SX1278Emulator::run(module.time_on_air(255) + 100);
+  }
+  stats = radio.stats();
+  CHECK(stats.tx_full == 1);
+  CHECK(stats.tx_frames_max == 10);
+  CHECK(stats.rx_overflows == 1);
+  CHECK(stats.rx_frames_max == 10);
+  while (radio.available()) {
+    radio.release();
+  }
+
+  radio.reset_stats();
+  stats = radio.stats();
+  CHECK(stats.frames_sent == 0 && histogram_total(stats.interrupt_time) == 0);
+}
+
+// second module on another channel, each radio keeps its own buffers and state
+static SX1278Emulator module_b;
+static BasicRadio<2, 10> radio_b(module_b, Radio::Config(434.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8));
+
+static void two_radios_in_parallel() {
+  radio_b.disable_debug();
+  CHECK(radio_b.begin());
+  CHECK(module_b.reg(0x06) == 0x6C && module_b.reg(0x07) == 0x80);
+  CHECK(module.reg(0x07) == 0x40);
+
+  module.receive(bytes("first"));
+  module_b.receive(bytes("second"));
+  SX1278Emulator::run(radio.time_on_air(7) + 1000);
+  char data[255];
+  CHECK(radio.available() == 1 && radio_b.available() == 1);
+  radio.receive(data);
+  CHECK(std::string(data) == "first");
+  radio_b.receive(data);
+  CHECK(std::string(data) == "second");
+
+  module.transmitted.clear();
+  module_b.transmitted.clear();
+  CHECK(radio.transmit("to first"));
+  CHECK(radio_b.transmit("to second"));
+  radio_b.flush();
+  radio.flush();
+  CHECK(module.transmitted.size() == 1 && module.transmitted[0].payload == bytes("to first"));
+  CHECK(module_b.transmitted.size() == 1 && module_b.transmitted[0].payload == bytes("to second"));
+  // both on air at once
+  CHECK(module.transmitted[0].start_us < module_b.transmitted[0].end_us);
+  CHECK(radio.verify_registers() && radio_b.verify_registers());
+}
+
+static void one_way_radios() {
+  static SX1278Emulator sender_module, receiver_module;
+  static BasicRadio<10, 0> sender(sender_module, config);
+  static BasicRadio<0, 10> receiver(receiver_module, config);
+  // no receive buffer, about 2.9 kB less
+  static_assert(sizeof(BasicRadio<10, 0>) + 10 * 256 < sizeof(Radio), "receive buffer not removed");
+  sender.disable_debug();
+  receiver.disable_debug();
+  CHECK(sender.begin() && receiver.begin());
+
+  CHECK(sender.transmit("telemetry"));
+  sender.flush();
+  CHECK(sender_module.transmitted.size() == 1);
+  sender_module.receive(bytes("command"));
+  SX1278Emulator::run(sender.time_on_air(8) + 1000);
+  CHECK(sender.available() == 0);
+  CHECK(sender.stats().rx_overflows == 1);
+
+  CHECK(!receiver.transmit("reply"));
+  CHECK(receiver.stats().tx_full == 1);
+  CHECK(receiver_module.transmitted.empty());
+  receiver_module.receive(bytes("telemetry"));
+  SX1278Emulator::run(receiver.time_on_air(10) + 1000);
+  char data[255];
+  CHECK(receiver.available() == 1);
+  receiver.receive(data);
+  CHECK(std::string(data) == "telemetry");
+}
+
+static void registers_stay_in_sync() {
+  CHECK(radio.verify_registers());
+}
+
+static void ignore_interrupt(void*) {}
+
+// SPI transactions mask DIO0 without nesting, register access inside block_interrupt() must not unmask it
+static void spi_transport_blocking_nests() {
+  SPITransport transport(10, 6);
+  transport.begin();
+  CHECK(transport.attach_interrupt(ignore_interrupt, nullptr));
+  uint8_t value = 0;
+  transport.read(0x42, &value, 1);
+  CHECK(!SPI.interrupt_masked);
+
+  transport.block_interrupt();
+  transport.block_interrupt();
+  transport.read(0x01, &value, 1);
+  transport.write(0x1D, &value, 1);
+  CHECK(SPI.interrupt_masked);
+  transport.unblock_interrupt();
+  transport.write(0x1E, &value, 1);
+  CHECK(SPI.interrupt_masked);
+  transport.unblock_interrupt();
+  CHECK(!SPI.interrupt_masked);
+}
+
+// DIO0 slots are freed by end() and the destructor, a transport with no slot left fails to attach
+static void spi_transport_interrupt_slots() {
+  SPITransport transports[SPITransport::max_interrupts] = {
+    {10, 6}, {11, 7}, {12, 8}, {13, 9},
+  };
+  for (auto& transport : transports) {
+    CHECK(transport.attach_interrupt(ignore_interrupt, nullptr));
+  }
+  SPITransport extra(14, 15);
+  CHECK(!extra.attach_interrupt(ignore_interrupt, nullptr));
+  transports[1].end();
+  CHECK(extra.attach_interrupt(ignore_interrupt, nullptr));
+  CHECK(!transports[1].attach_interrupt(ignore_interrupt, nullptr));
+  {
+    SPITransport destroyed(16, 17);
+    extra.detach_interrupt();
+    CHECK(destroyed.attach_interrupt(ignore_interrupt, nullptr));
+  }
+  CHECK(transports[1].attach_interrupt(ignore_interrupt, nullptr));
+}
+
+int main() {
+  radio.disable_debug();
+
+  RUN_TEST(begin_configures_module);
+  RUN_TEST(begin_fails_without_module);
+  RUN_TEST(transmit_string);
+  RUN_TEST(transmit_frame_in_place);
+  RUN_TEST(fill_transmit_buffer);
+  RUN_TEST(receive_frames);
+  RUN_TEST(receive_and_flush_with_timeout);
+  RUN_TEST(callbacks_from_poll);
+  RUN_TEST(frame_info_of_each_frame);
+  RUN_TEST(crc_errors_are_dropped);
+  RUN_TEST(interrupt_debug_messages_are_deferred);
+  RUN_TEST(receive_buffer_overflow);
+  RUN_TEST(receive_many_short_frames);
+  RUN_TEST(receive_while_transmitting_is_missed);
+  RUN_TEST(time_on_air_matches_module);
+  RUN_TEST(implicit_header_and_sf6);
+  RUN_TEST(set_config_while_running);
+  RUN_TEST(retune_with_queued_frames);
+  RUN_TEST(retune_holds_interrupt);
+  RUN_TEST(retune_implicit_header_with_reserved_frame);
+  RUN_TEST(listen_before_talk);
+  RUN_TEST(back_to_back_frames);
+  RUN_TEST(high_priority_goes_first);
+  RUN_TEST(priority_aging);
+  RUN_TEST(latest_value_replaces_waiting_frame);
+  RUN_TEST(drop_oldest_when_full);
+  RUN_TEST(tx_queue_time_follows_transmission);
+  RUN_TEST(aggregation_packs_messages);
+  RUN_TEST(aggregation_splits_received_frames);
+  RUN_TEST(stats_count_traffic);
+  RUN_TEST(two_radios_in_parallel);
+  RUN_TEST(one_way_radios);
+  RUN_TEST(registers_stay_in_sync);
+  RUN_TEST(spi_transport_blocking_nests);
+  RUN_TEST(spi_transport_interrupt_slots);
+
+  return host_test_result("radio_test");
+}
@@ -0,0 +1,225 @@
+// ReliableLink between Radio (SX1278 emulator) and a second link on a simple model of the other radio.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc -Itests/host tests/host/reliable_link_test.cpp tests/host/sx1278_emulator.cpp
+//     tests/host/arduino.cpp src/CanSatKitRadio*.cpp -o reliable_link_test && ./reliable_link_test
+
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "Arduino.h"
+#include "CanSatKit.h"
+#include "CanSatKitReliableLink.h"
+#include "host_test.h"
+#include "sx1278_emulator.h"
+
+using namespace CanSatKit;
+
+static SX1278Emulator module;
+static Radio radio(module, Radio::Config(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8));
+
+static std::mt19937 random_engine(1);
+
+// The other side of the link: half-duplex radio sending frames to module and receiving frames
+// transmitted by module, each frame lost with given probability.
+// Answers start after a turnaround time (mode switch and main loop latency of the other board).
+class PeerRadio {
+ public:
+  explicit PeerRadio(double loss_) : loss(loss_), next_seen(module.transmitted.size()), busy_until(host_time_us) {}
+
+  uint8_t max_frame_length() const { return 255; }
+  uint32_t time_on_air(uint8_t length) const { return module.time_on_air(length); }
+
+  uint8_t* reserve(uint8_t length) {
+    reserved.assign(length, 0);
+    return reserved.data();
+  }
+
+  bool commit(uint8_t length) {
+    reserved.resize(length);
+    uint64_t start = busy_until > host_time_us ? busy_until : host_time_us + turnaround_us;
+    busy_until = start + time_on_air(length);
+    outgoing.push_back(Outgoing{reserved, start});
+    transmitting.push_back(std::make_pair(start, busy_until));
+    return true;
+  }
+
+  bool tx_fifo_empty() const { return outgoing.empty(); }
+  uint32_t tx_queue_time() const { return busy_until > host_time_us ? busy_until - host_time_us : 0; }
+
+  const uint8_t* peek(uint8_t& length) {
+    if (received.empty()) {
+      return nullptr;
+    }
+    length = received.front().size();
+    return received.front().data();
+  }
+
+  void release() { received.pop_front(); }
+
+  // move frames between the air and this radio
+  void service() {
+    while (!outgoing.empty() && outgoing.front().start <= host_time_us) {
+      // lost frame reaches the module with CRC error
+      module.receive(outgoing.front().payload, -60, 9.0f, !lost());
+      outgoing.pop_front();
+    }
+    while (next_seen < module.transmitted.size() && module.transmitted[next_seen].end_us <= host_time_us) {
+      auto& packet = module.transmitted[next_seen++];
+      if (!overlaps_transmission(packet.start_us, packet.end_us) && !lost()) {
+        received.push_back(packet.payload);
+      }
+    }
+  }
+
+ private:
+  struct Outgoing {
+    std::vector<uint8_t> payload;
+    uint64_t start;
+  };
+
+  bool lost() {
+    return std::bernoulli_distribution(loss)(random_engine);
+  }
+
+  bool overlaps_transmission(uint64_t start, uint64_t end) const {
+    for (auto& t : transmitting) {
+      if (start < t.second && t.first < end) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static constexpr uint64_t turnaround_us = 10000;
+
+  double loss;
+  size_t next_seen;
+  uint64_t busy_until;
+  std::vector<uint8_t> reserved;
+  std::deque<Outgoing> outgoing;
+  std::deque<std::vector<uint8_t>> received;
+  std::vector<std::pair<uint64_t, uint64_t>> transmitting;
+};
+
+static std::vector<uint8_t> make_frame(int i, uint8_t length = 200) {
+  std::vector<uint8_t> frame(length);
+  for (size_t k = 0; k < frame.size(); ++k) {
+    frame[k] = static_cast<uint8_t>(i + k);
+  }
+  return frame;
+}
+
+struct Transfer {
+  bool in_order;
+  uint64_t duration_us;
+  uint32_t retransmissions;
+  uint32_t rtt;
+  uint32_t lost_answers;
+};
+
+// send frames from the can (Radio) to the ground station (peer) and optionally back
+template<uint8_t window>
+static Transfer transfer(int frames, int frames_back, double loss, uint8_t frame_length = 200) {
+  uint8_t length;
+  while (radio.peek(length)) {
+    radio.release();
+  }
+  PeerRadio peer_radio(loss);
+  ReliableLink<window> can(radio);
+  ReliableLink<window, PeerRadio> ground(peer_radio);
+
+  int sent = 0, sent_back = 0, received = 0, received_back = 0;
+  bool in_order = true;
+  uint64_t start = host_time_us;
+  while ((received < frames || received_back < frames_back) && host_time_us - start < 600000000ull) {
+    // keep the window full
+    while (sent < frames && can.send(make_frame(sent, frame_length).data(), frame_length)) {
+      sent++;
+    }
+    while (sent_back < frames_back && ground.send(make_frame(1000 + sent_back, frame_length).data(), frame_length)) {
+      sent_back++;
+    }
+    can.poll();
+    peer_radio.service();
+    ground.poll();
+    peer_radio.service();
+
+    const uint8_t* data;
+    while ((data = ground.peek(length)) != nullptr) {
+      in_order = in_order && std::vector<uint8_t>(data, data + length) == make_frame(received++, frame_length);
+      ground.release();
+    }
+    while ((data = can.peek(length)) != nullptr) {
+      in_order = in_order && std::vector<uint8_t>(data, data + length) == make_frame(1000 + received_back++, frame_length);
+      can.release();
+    }
+    SX1278Emulator::run(1000);
+  }
+  Transfer result = {in_order && received == frames && received_back == frames_back, host_time_us - start,
+                     can.retransmissions() + ground.retransmissions(), can.rtt(),
+                     can.lost_answers() + ground.lost_answers()};
+  // let the last acknowledgement go
+  SX1278Emulator::run(100000);
+  return result;
+}
+
+static void transfer_without_loss() {
+  CHECK(radio.begin());
+  auto result = transfer<8>(40, 0, 0.0);
+  CHECK(result.in_order);
+  CHECK(result.retransmissions == 0);
+  CHECK(result.rtt > 0);
+  double airtime = 40.0 * radio.time_on_air(200 + ReliableLink<>::header_length);
+  std::printf("  40 x 200 B: %.2f s, airtime %.0f%% of it\n", result.duration_us / 1e6, 100 * airtime / result.duration_us);
+}
+
+static void transfer_with_loss() {
+  auto result = transfer<8>(100, 0, 0.1);
+  CHECK(result.in_order);
+  CHECK(result.retransmissions > 0);
+  std::printf("  100 x 200 B at 10%% loss: %.2f s, %u frames sent again\n", result.duration_us / 1e6, result.retransmissions);
+}
+
+static void transfer_both_directions() {
+  auto result = transfer<8>(50, 50, 0.1);
+  CHECK(result.in_order);
+}
+
+// each answer costs a turnaround and an acknowledgement, shared by the whole window
+static void window_is_faster_than_stop_and_wait() {
+  for (uint8_t length : {50, 200}) {
+    auto windowed = transfer<8>(80, 0, 0.05, length);
+    auto stop_and_wait = transfer<1>(80, 0, 0.05, length);
+    CHECK(windowed.in_order && stop_and_wait.in_order);
+    std::printf("  80 x %3u B at 5%% loss: window 8 %.2f s, stop-and-wait %.2f s\n",
+                length, windowed.duration_us / 1e6, stop_and_wait.duration_us / 1e6);
+    CHECK(stop_and_wait.duration_us > windowed.duration_us);
+  }
+}
+
+static void rejects_too_long_frames() {
+  ReliableLink<> link(radio);
+  uint8_t data[255] = {};
+  CHECK(!link.send(data, 0));
+  CHECK(!link.send(data, 252));
+  CHECK(link.send(data, 251));
+  for (int i = 1; i < 8; ++i) {
+    CHECK(link.send(data, 1));
+  }
+  // window full
+  CHECK(!link.send(data, 1));
+}
+
+int main() {
+  radio.disable_debug();
+
+  RUN_TEST(transfer_without_loss);
+  RUN_TEST(transfer_with_loss);
+  RUN_TEST(transfer_both_directions);
+  RUN_TEST(window_is_faster_than_stop_and_wait);
+  RUN_TEST(rejects_too_long_frames);
+
+  return host_test_result("reliable_link_test");
+}
@@ -0,0 +1,413 @@
+#include "sx1278_emulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Arduino.h"
+
+using std::uint8_t;
+using std::uint64_t;
+
+namespace {
+
+enum Register : uint8_t {
+  REG_FIFO = 0x00,
+  REG_OP_MODE = 0x01,
+  REG_FIFO_ADDR_PTR = 0x0D,
+  REG_FIFO_TX_BASE_ADDR = 0x0E,
+  REG_FIFO_RX_BASE_ADDR = 0x0F,
+  REG_FIFO_RX_CURRENT_ADDR = 0x10,
+  REG_IRQ_FLAGS_MASK = 0x11,
+  REG_IRQ_FLAGS = 0x12,
+  REG_RX_NB_BYTES = 0x13,
+  REG_PKT_SNR_VALUE = 0x19,
+  REG_PKT_RSSI_VALUE = 0x1A,
+  REG_RSSI_VALUE = 0x1B,
+  REG_MODEM_CONFIG_1 = 0x1D,
+  REG_MODEM_CONFIG_2 = 0x1E,
+  REG_PREAMBLE_MSB = 0x20,
+  REG_PREAMBLE_LSB = 0x21,
+  REG_PAYLOAD_LENGTH = 0x22,
+  REG_MODEM_CONFIG_3 = 0x26,
+  REG_FEI_MSB = 0x28,
+  REG_FEI_MID = 0x29,
+  REG_FEI_LSB = 0x2A,
+  REG_FIFO_RX_BYTE_ADDR = 0x25,
+  REG_DIO_MAPPING_1 = 0x40,
+  REG_VERSION = 0x42,
+};
+
+enum Mode : uint8_t {
+  MODE_SLEEP = 0b000,
+  MODE_STANDBY = 0b001,
+  MODE_TX = 0b011,
+  MODE_RXCONTINUOUS = 0b101,
+  MODE_RXSINGLE = 0b110,
+  MODE_CAD = 0b111,
+};
+
+enum IrqFlag : uint8_t {
+  IRQ_RX_DONE = 0b01000000,
+  IRQ_PAYLOAD_CRC_ERROR = 0b00100000,
+  IRQ_VALID_HEADER = 0b00010000,
+  IRQ_TX_DONE = 0b00001000,
+  IRQ_CAD_DONE = 0b00000100,
+  IRQ_CAD_DETECTED = 0b00000001,
+};
+
+constexpr uint8_t LORA = 0b10000000;
+constexpr uint64_t NEVER = ~0ull;
+// SPI clock used by SPITransport
+constexpr uint64_t SPI_HZ = 2000000;
+
+// function-local, emulators are usually global objects in other files
+std::vector<SX1278Emulator*>& all_emulators() {
+  static std::vector<SX1278Emulator*> emulators;
+  return emulators;
+}
+
+double bandwidth_hz(uint8_t modem_config_1) {
+  static const double table[] = {7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000};
+  uint8_t index = modem_config_1 >> 4;
+  return index < 10 ? table[index] : 500000;
+}
+
+}  // namespace
+
+SX1278Emulator::SX1278Emulator() {
+  // reset values from the datasheet
+  memset(regs, 0, sizeof(regs));
+  memset(fifo, 0, sizeof(fifo));
+  regs[REG_OP_MODE] = 0x09;
+  regs[0x06] = 0x6C;
+  regs[0x07] = 0x80;
+  regs[0x09] = 0x4F;
+  regs[0x0A] = 0x09;
+  regs[0x0B] = 0x2B;
+  regs[0x0C] = 0x20;
+  regs[REG_FIFO_TX_BASE_ADDR] = 0x80;
+  regs[REG_MODEM_CONFIG_1] = 0x72;
+  regs[REG_MODEM_CONFIG_2] = 0x70;
+  regs[0x1F] = 0x64;
+  regs[REG_PREAMBLE_LSB] = 0x08;
+  regs[REG_PAYLOAD_LENGTH] = 0x01;
+  regs[0x23] = 0xFF;
+  regs[REG_MODEM_CONFIG_3] = 0x04;
+  regs[0x31] = 0xC3;
+  regs[0x37] = 0x0A;
+  regs[0x39] = 0x12;
+  regs[REG_VERSION] = 0x12;
+  regs[0x4D] = 0x84;
+
+  all_emulators().push_back(this);
+  host_run = &SX1278Emulator::run;
+}
+
+SX1278Emulator::~SX1278Emulator() {
+  auto& emulators = all_emulators();
+  emulators.erase(std::find(emulators.begin(), emulators.end(), this));
+  for (auto emulator : emulators) {
+    auto& p = emulator->peers;
+    p.erase(std::remove(p.begin(), p.end(), this), p.end());
+  }
+  if (emulators.empty()) {
+    host_run = nullptr;
+  }
+}
+
+void SX1278Emulator::begin() {}
+
+void SX1278Emulator::end() {
+  detach_interrupt();
+}
+
+void SX1278Emulator::spi_transaction(uint8_t length) {
+  spi_transactions++;
+  spi_bytes += length + 1u;
+  // address byte + data at SPI clock, SPI time is part of simulated time
+  host_time_us += ((length + 1u) * 8 * 1000000ull + SPI_HZ - 1) / SPI_HZ;
+}
+
+void SX1278Emulator::read(uint8_t reg, uint8_t* data, uint8_t length) {
+  spi_transaction(length);
+  while (length--) {
+    if (reg == REG_FIFO) {
+      *data++ = fifo[regs[REG_FIFO_ADDR_PTR]++];
+    } else {
+      *data++ = reg == REG_VERSION && !present ? 0 : regs[reg & 0x7F];
+      reg++;
+    }
+  }
+}
+
+void SX1278Emulator::write(uint8_t reg, const uint8_t* data, uint8_t length) {
+  spi_transaction(length);
+  uint8_t first = reg;
+  while (length--) {
+    if (reg == REG_FIFO) {
+      fifo[regs[REG_FIFO_ADDR_PTR]++] = *data++;
+    } else {
+      write_register(reg, *data++);
+      reg++;
+    }
+  }
+  // DIO0 may go high eg. after changing the mapping
+  service_interrupt();
+  if (on_write) {
+    on_write(first);
+  }
+}
+
+void SX1278Emulator::write_register(uint8_t address, uint8_t value) {
+  address &= 0x7F;
+  switch (address) {
+    case REG_IRQ_FLAGS:
+      // write 1 to clear
+      regs[REG_IRQ_FLAGS] &= ~value;
+      break;
+    case REG_VERSION:
+    case REG_FIFO_RX_CURRENT_ADDR:
+    case REG_RX_NB_BYTES:
+    case REG_PKT_SNR_VALUE:
+    case REG_PKT_RSSI_VALUE:
+    case REG_RSSI_VALUE:
+    case REG_FEI_MSB:
+    case REG_FEI_MID:
+    case REG_FEI_LSB:
+      // read only
+      break;
+    case REG_OP_MODE: {
+      uint8_t current = regs[REG_OP_MODE];
+      // LoRa/FSK can be changed only in sleep mode
+      if ((current & 0b111) != MODE_SLEEP) {
+        value = (value & ~LORA) | (current & LORA);
+      }
+      regs[REG_OP_MODE] = (value & ~0b111) | (current & 0b111);
+      set_mode(value & 0b111);
+      break;
+    }
+    default:
+      regs[address] = value;
+  }
+}
+
+void SX1278Emulator::set_mode(uint8_t new_mode) {
+  uint8_t old_mode = mode();
+  regs[REG_OP_MODE] = (regs[REG_OP_MODE] & ~0b111) | new_mode;
+  if (new_mode == old_mode) {
+    return;
+  }
+  // leaving TX or CAD aborts it
+  tx_end_us = 0;
+  cad_end_us = 0;
+
+  if (new_mode == MODE_SLEEP) {
+    memset(fifo, 0, sizeof(fifo));
+  } else if (new_mode == MODE_TX) {
+    std::vector<uint8_t> payload(regs[REG_PAYLOAD_LENGTH]);
+    uint8_t address = regs[REG_FIFO_TX_BASE_ADDR];
+    for (auto& byte : payload) {
+      byte = fifo[address++];
+    }
+    Packet packet = {payload, host_time_us, host_time_us + time_on_air(payload.size()), 0, 0.0f, true, 0};
+    tx_end_us = packet.end_us;
+    transmitted.push_back(packet);
+    for (auto peer : peers) {
+      Packet received = packet;
+      received.rssi_dbm = -60;
+      received.snr_db = 9.0f;
+      peer->incoming.push_back(received);
+    }
+  } else if (new_mode == MODE_RXCONTINUOUS || new_mode == MODE_RXSINGLE) {
+    rx_write_ptr = regs[REG_FIFO_RX_BASE_ADDR];
+    rx_since_us = host_time_us;
+  } else if (new_mode == MODE_CAD) {
+    // about two symbols
+    cad_start_us = host_time_us;
+    cad_end_us = host_time_us + static_cast<uint64_t>(std::lround(
+        2 * std::ldexp(1.0, regs[REG_MODEM_CONFIG_2] >> 4) / bandwidth_hz(regs[REG_MODEM_CONFIG_1]) * 1e6));
+  }
+}
+
+void SX1278Emulator::raise(uint8_t flags) {
+  regs[REG_IRQ_FLAGS] |= flags & ~regs[REG_IRQ_FLAGS_MASK];
+}
+
+bool SX1278Emulator::dio0() const {
+  static const uint8_t flag_for_mapping[] = {IRQ_RX_DONE, IRQ_TX_DONE, IRQ_CAD_DONE, 0};
+  return regs[REG_IRQ_FLAGS] & flag_for_mapping[regs[REG_DIO_MAPPING_1] >> 6];
+}
+
+bool SX1278Emulator::attach_interrupt(void (*handler_)(void*), void* context) {
+  handler = handler_;
+  handler_context = context;
+  return true;
+}
+
+void SX1278Emulator::detach_interrupt() {
+  handler = nullptr;
+}
+
+void SX1278Emulator::block_interrupt() {
+  blocked++;
+}
+
+void SX1278Emulator::unblock_interrupt() {
+  blocked--;
+  service_interrupt();
+}
+
+void SX1278Emulator::service_interrupt() {
+  if (!handler || blocked || in_handler) {
+    return;
+  }
+  // level triggered (HIGH): handler runs until DIO0 goes low
+  in_handler = true;
+  int calls = 0;
+  while (dio0()) {
+    if (++calls > 100) {
+      std::printf("SX1278Emulator: DIO0 stuck high (IRQ flags 0x%02X)\n", regs[REG_IRQ_FLAGS]);
+      std::abort();
+    }
+    handler(handler_context);
+  }
+  in_handler = false;
+}
+
+void SX1278Emulator::finish_transmission() {
+  tx_end_us = 0;
+  regs[REG_OP_MODE] = (regs[REG_OP_MODE] & ~0b111) | MODE_STANDBY;
+  raise(IRQ_TX_DONE);
+}
+
+void SX1278Emulator::finish_cad() {
+  // any packet on air during the detection window (preamble or payload)
+  bool detected = false;
+  for (auto& packet : incoming) {
+    detected = detected || packet.start_us < cad_end_us;
+  }
+  detected = detected || last_incoming_end_us > cad_start_us;
+  cad_end_us = 0;
+  regs[REG_OP_MODE] = (regs[REG_OP_MODE] & ~0b111) | MODE_STANDBY;
+  raise(IRQ_CAD_DONE | (detected ? IRQ_CAD_DETECTED : 0));
+}
+
+void SX1278Emulator::finish_reception(const Packet& packet) {
+  bool listening = (mode() == MODE_RXCONTINUOUS || mode() == MODE_RXSINGLE) && rx_since_us <= packet.start_us;
+  if (!listening || !(regs[REG_OP_MODE] & LORA)) {
+    missed++;
+    return;
+  }
+  // the next packet overlapping this one is lost
+  rx_since_us = packet.end_us;
+
+  bool implicit_header = regs[REG_MODEM_CONFIG_1] & 0b1;
+  uint8_t length = implicit_header ? regs[REG_PAYLOAD_LENGTH] : packet.payload.size();
+  regs[REG_FIFO_RX_CURRENT_ADDR] = rx_write_ptr;
+  for (uint8_t i = 0; i < length; ++i) {
+    fifo[rx_write_ptr++] = i < packet.payload.size() ? packet.payload[i] : 0;
+  }
+  regs[REG_FIFO_RX_BYTE_ADDR] = rx_write_ptr;
+  regs[REG_RX_NB_BYTES] = length;
+  regs[REG_PKT_SNR_VALUE] = static_cast<uint8_t>(static_cast<int8_t>(std::lround(packet.snr_db * 4)));
+  regs[REG_PKT_RSSI_VALUE] = static_cast<uint8_t>(std::min(255, std::max(0, packet.rssi_dbm + 164)));
+  // 20-bit FEI, Ferr = FEI * 2^24 / 32 MHz * bandwidth / 500 kHz
+  long fei = std::lround(packet.frequency_error_hz * 32e6 / (1 << 24) * 500000 / bandwidth_hz(regs[REG_MODEM_CONFIG_1]));
+  regs[REG_FEI_MSB] = (fei >> 16) & 0x0F;
+  regs[REG_FEI_MID] = (fei >> 8) & 0xFF;
+  regs[REG_FEI_LSB] = fei & 0xFF;
+  raise(IRQ_RX_DONE | IRQ_VALID_HEADER | (packet.crc_ok ? 0 : IRQ_PAYLOAD_CRC_ERROR));
+  if (mode() == MODE_RXSINGLE) {
+    regs[REG_OP_MODE] = (regs[REG_OP_MODE] & ~0b111) | MODE_STANDBY;
+  }
+}
+
+void SX1278Emulator::receive(const std::vector<uint8_t>& payload, int rssi_dbm, float snr_db, bool crc_ok, int32_t frequency_error_hz) {
+  Packet packet = {payload, host_time_us, host_time_us + time_on_air(payload.size()), rssi_dbm, snr_db, crc_ok, frequency_error_hz};
+  incoming.push_back(packet);
+}
+
+void SX1278Emulator::connect(SX1278Emulator& peer) {
+  peers.push_back(&peer);
+  peer.peers.push_back(this);
+}
+
+std::uint32_t SX1278Emulator::time_on_air(uint8_t payload_length) const {
+  int sf = regs[REG_MODEM_CONFIG_2] >> 4;
+  int cr = (regs[REG_MODEM_CONFIG_1] >> 1) & 0b111;
+  bool implicit_header = regs[REG_MODEM_CONFIG_1] & 0b1;
+  bool crc = regs[REG_MODEM_CONFIG_2] & 0b100;
+  bool low_data_rate = regs[REG_MODEM_CONFIG_3] & 0b1000;
+  int preamble = (regs[REG_PREAMBLE_MSB] << 8) | regs[REG_PREAMBLE_LSB];
+
+  double symbol_us = std::ldexp(1.0, sf) / bandwidth_hz(regs[REG_MODEM_CONFIG_1]) * 1e6;
+  double payload_bits = 8.0 * payload_length - 4 * sf + 28 + 16 * crc - 20 * implicit_header;
+  double payload_symbols = 8 + std::max(std::ceil(payload_bits / (4 * (sf - 2 * low_data_rate))) * (cr + 4), 0.0);
+  return static_cast<std::uint32_t>(std::lround((preamble + 4.25 + payload_symbols) * symbol_us));
+}
+
+uint64_t SX1278Emulator::next_event() const {
+  uint64_t next = tx_end_us ? tx_end_us : NEVER;
+  if (cad_end_us) {
+    next = std::min(next, cad_end_us);
+  }
+  for (auto& packet : incoming) {
+    next = std::min(next, packet.end_us);
+  }
+  return next;
+}
+
+void SX1278Emulator::process_events(uint64_t time_us) {
+  if (tx_end_us && tx_end_us <= time_us) {
+    finish_transmission();
+  }
+  if (cad_end_us && cad_end_us <= time_us) {
+    finish_cad();
+  }
+  for (size_t i = 0; i < incoming.size();) {
+    if (incoming[i].end_us <= time_us) {
+      Packet packet = incoming[i];
+      incoming.erase(incoming.begin() + i);
+      // packets overlapping on air are corrupted (collision of similar power)
+      bool overlapping = last_incoming_end_us > packet.start_us;
+      for (auto& other : incoming) {
+        overlapping = overlapping || other.start_us < packet.end_us;
+      }
+      last_incoming_end_us = std::max(last_incoming_end_us, packet.end_us);
+      if (overlapping) {
+        collisions++;
+        packet.crc_ok = false;
+      }
+      finish_reception(packet);
+    } else {
+      ++i;
+    }
+  }
+  service_interrupt();
+}
+
+void SX1278Emulator::run_until(uint64_t time_us) {
+  auto& emulators = all_emulators();
+  while (true) {
+    uint64_t next = NEVER;
+    for (auto emulator : emulators) {
+      next = std::min(next, emulator->next_event());
+    }
+    if (next > time_us) {
+      break;
+    }
+    // interrupt handlers may run late (eg. SPI traffic), time never goes back
+    host_time_us = std::max(host_time_us, next);
+    for (size_t i = 0; i < emulators.size(); ++i) {
+      emulators[i]->process_events(host_time_us);
+    }
+  }
+  host_time_us = std::max(host_time_us, time_us);
+}
+
+void SX1278Emulator::run(std::uint32_t duration_us) {
+  run_until(host_time_us + duration_us);
+}
@@ -0,0 +1,98 @@
+// SX1278 (LoRa mode) emulator for host tests: register file, 256-byte FIFO,
+// IRQ flags, DIO0 interrupt, time-on-air of transmitted/received packets,
+// channel activity detection and collisions of overlapping packets.
+#ifndef CANSATKITLIBRARY_TESTS_HOST_SX1278_EMULATOR_H_
+#define CANSATKITLIBRARY_TESTS_HOST_SX1278_EMULATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "CanSatKitRadioTransport.h"
+
+class SX1278Emulator : public CanSatKit::RadioTransport {
+ public:
+  struct Packet {
+    std::vector<std::uint8_t> payload;
+    std::uint64_t start_us;
+    std::uint64_t end_us;
+    int rssi_dbm;
+    float snr_db;
+    bool crc_ok;
+    std::int32_t frequency_error_hz;
+  };
+
+  SX1278Emulator();
+  ~SX1278Emulator();
+
+  // RadioTransport
+  virtual void begin();
+  virtual void end();
+  virtual void read(std::uint8_t reg, std::uint8_t* data, std::uint8_t length);
+  virtual void write(std::uint8_t reg, const std::uint8_t* data, std::uint8_t length);
+  virtual bool attach_interrupt(void (*handler)(void*), void* context);
+  virtual void detach_interrupt();
+  virtual void block_interrupt();
+  virtual void unblock_interrupt();
+
+  // Advance simulated time of all emulators, firing DIO0 interrupts on the way.
+  static void run(std::uint32_t duration_us);
+  static void run_until(std::uint64_t time_us);
+
+  // Packet sent over the air towards this module, starting now.
+  void receive(const std::vector<std::uint8_t>& payload, int rssi_dbm = -60, float snr_db = 9.0f, bool crc_ok = true,
+               std::int32_t frequency_error_hz = 0);
+
+  // Packets transmitted by this module also reach the peer (both directions).
+  void connect(SX1278Emulator& peer);
+
+  // Time on air of a packet with current modem registers.
+  std::uint32_t time_on_air(std::uint8_t payload_length) const;
+
+  std::uint8_t reg(std::uint8_t address) const { return regs[address]; }
+  std::uint8_t mode() const { return regs[0x01] & 0b111; }
+  bool dio0() const;
+
+  // every packet transmitted by this module
+  std::vector<Packet> transmitted;
+  // packets that reached the antenna but were not received (wrong mode, overlapping, ...)
+  unsigned missed = 0;
+  // packets that overlapped another one on air, received with CRC error if at all
+  unsigned collisions = 0;
+
+  unsigned spi_transactions = 0;
+  unsigned spi_bytes = 0;
+  // module present on the bus (VERSION reads 0 otherwise)
+  bool present = true;
+  // called after each register write (first register of a burst), eg. to run time on meanwhile
+  void (*on_write)(std::uint8_t reg) = nullptr;
+
+ private:
+  void write_register(std::uint8_t address, std::uint8_t value);
+  void set_mode(std::uint8_t mode);
+  void finish_transmission();
+  void finish_reception(const Packet& packet);
+  void finish_cad();
+  void raise(std::uint8_t flags);
+  void spi_transaction(std::uint8_t length);
+  void service_interrupt();
+  std::uint64_t next_event() const;
+  void process_events(std::uint64_t time_us);
+
+  std::uint8_t regs[128];
+  std::uint8_t fifo[256];
+  std::uint8_t rx_write_ptr = 0;
+  std::uint64_t rx_since_us = 0;
+  std::uint64_t tx_end_us = 0;
+  std::uint64_t cad_start_us = 0;
+  std::uint64_t cad_end_us = 0;
+  std::uint64_t last_incoming_end_us = 0;
+  std::vector<Packet> incoming;
+  std::vector<SX1278Emulator*> peers;
+
+  void (*handler)(void*) = nullptr;
+  void* handler_context = nullptr;
+  int blocked = 0;
+  bool in_handler = false;
+};
+
+#endif  // CANSATKITLIBRARY_TESTS_HOST_SX1278_EMULATOR_H_
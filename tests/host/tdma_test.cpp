@@ -0,0 +1,226 @@
+// Time division between three nodes (TdmaNode) and a ground station (TdmaGround),
+// each on its own SX1278 emulator, all on one channel.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc -Itests/host tests/host/tdma_test.cpp tests/host/sx1278_emulator.cpp
+//     tests/host/arduino.cpp src/CanSatKitRadio*.cpp -o tdma_test && ./tdma_test
+
+#include <cstdio>
+#include <vector>
+
+#include "Arduino.h"
+#include "CanSatKit.h"
+#include "CanSatKitTdma.h"
+#include "host_test.h"
+#include "sx1278_emulator.h"
+
+using namespace CanSatKit;
+
+static constexpr Radio::Config config(433.0, Bandwidth_125000_Hz, SpreadingFactor_7, CodingRate_4_8);
+static constexpr int node_count = 3;
+static constexpr uint8_t frame_length = 20;
+
+static SX1278Emulator ground_module, node_modules[node_count];
+static Radio ground_radio(ground_module, config);
+static Radio node_radios[node_count] = {{node_modules[0], config}, {node_modules[1], config}, {node_modules[2], config}};
+static TdmaNode<> nodes[node_count] = {{node_radios[0], 1}, {node_radios[1], 2}, {node_radios[2], 3}};
+
+// frames received by the ground station from each node (first byte), others
+static uint32_t received[node_count + 1];
+
+// everyone hears everyone
+static void connect_all() {
+  for (int i = 0; i < node_count; ++i) {
+    node_modules[i].connect(ground_module);
+    for (int j = i + 1; j < node_count; ++j) {
+      node_modules[i].connect(node_modules[j]);
+    }
+  }
+}
+
+// nodes keep their transmit buffers full, the ground station counts what arrives
+template<class Ground>
+static void run(Ground* ground, uint32_t duration_ms) {
+  uint64_t end = host_time_us + duration_ms * 1000ull;
+  while (host_time_us < end) {
+    if (ground) {
+      ground->poll();
+    }
+    uint8_t data[255], length;
+    while (ground_radio.available()) {
+      ground_radio.receive(data, length);
+      received[data[0] < node_count ? data[0] : node_count]++;
+    }
+    for (int i = 0; i < node_count; ++i) {
+      Radio::FrameInfo info;
+      while (node_radios[i].available()) {
+        node_radios[i].receive(data, length, info);
+        nodes[i].handle(data, length, info);
+      }
+      uint8_t frame[frame_length] = {static_cast<uint8_t>(i)};
+      node_radios[i].transmit(frame, sizeof(frame));
+      node_radios[i].poll();
+    }
+    SX1278Emulator::run(1000);
+  }
+}
+
+// beacons are the 4-byte frames of the ground station
+static std::vector<uint64_t> beacon_starts() {
+  std::vector<uint64_t> starts;
+  for (auto& packet : ground_module.transmitted) {
+    if (packet.payload.size() == TdmaLink<Radio>::frame_length && packet.payload[0] == 0xBC) {
+      starts.push_back(packet.start_us);
+    }
+  }
+  return starts;
+}
+
+// every frame of the node starts and ends in its slot of the period it was sent in
+static bool frames_in_slot(int node, const TdmaGround<>& ground) {
+  auto beacons = beacon_starts();
+  uint64_t beacon_us = config.time_on_air(TdmaLink<Radio>::frame_length);
+  for (auto& packet : node_modules[node].transmitted) {
+    uint64_t epoch = 0;
+    for (auto start : beacons) {
+      if (start <= packet.start_us) {
+        epoch = start;
+      }
+    }
+    if (epoch == 0) {
+      // sent in a period whose beacon was cleared from the list
+      continue;
+    }
+    uint64_t slot_start = epoch + beacon_us + (node + 1) * ground.slot_length();
+    // beacon timestamp (end of reception) and sending it take a few SPI transactions
+    if (packet.start_us + 200 < slot_start || packet.end_us > slot_start + ground.slot_length()) {
+      std::printf("  node %d: frame at %llu us outside of slot at %llu us\n", node + 1,
+                  static_cast<unsigned long long>(packet.start_us), static_cast<unsigned long long>(slot_start));
+      return false;
+    }
+  }
+  return true;
+}
+
+static void nothing_sent_before_beacon() {
+  connect_all();
+  ground_radio.disable_debug();
+  CHECK(ground_radio.begin());
+  for (int i = 0; i < node_count; ++i) {
+    node_radios[i].disable_debug();
+    CHECK(node_radios[i].begin());
+    nodes[i].begin();
+  }
+  run<TdmaGround<>>(nullptr, 2000);
+  for (int i = 0; i < node_count; ++i) {
+    CHECK(node_modules[i].transmitted.empty());
+    CHECK(!nodes[i].is_synchronised());
+    CHECK(node_radios[i].stats().slot_waits == 1);
+  }
+}
+
+// no slot to wait for, the beacon can only be handled after flush() returns
+static void flush_before_first_beacon() {
+  uint64_t start = host_time_us;
+  node_radios[0].flush();
+  CHECK(!node_radios[0].flush(1000));
+  CHECK(node_radios[0].set_config(config));
+  CHECK(host_time_us - start < 10000);
+  CHECK(!node_radios[0].tx_fifo_empty());
+  CHECK(node_modules[0].transmitted.empty());
+  CHECK(node_radios[0].verify_registers());
+}
+
+static void nodes_send_in_their_slots() {
+  TdmaGround<> ground(ground_radio, node_count, 1, frame_length);
+  ground.begin();
+  // beacon, slot 0 and three slots of one 20-byte frame (78 ms) with 2 ms guard
+  CHECK(ground.slot_length() == config.time_on_air(frame_length) + TdmaLink<Radio>::guard_us);
+  CHECK(ground.period() == config.time_on_air(TdmaLink<Radio>::frame_length) + 4 * ground.slot_length());
+
+  run(&ground, 30000);
+  for (int i = 0; i < node_count; ++i) {
+    CHECK(nodes[i].is_synchronised());
+    CHECK(frames_in_slot(i, ground));
+  }
+  CHECK(ground_module.collisions == 0);
+  CHECK(ground_radio.stats().crc_errors == 0);
+  // a frame of each node in each period (and the first frames held before the beacon)
+  uint32_t periods = beacon_starts().size();
+  for (int i = 0; i < node_count; ++i) {
+    CHECK(received[i] + 1 >= periods && received[i] <= periods + 10);
+  }
+  std::printf("  %u periods of %u ms: %u, %u, %u frames received\n", periods, ground.period() / 1000,
+              received[0], received[1], received[2]);
+}
+
+static void ground_station_sends_in_slot_0() {
+  TdmaGround<> ground(ground_radio, node_count, 1, frame_length);
+  ground.begin();
+  run(&ground, 1000);
+  ground_module.transmitted.clear();
+  const uint8_t command[10] = {'C'};
+  CHECK(ground_radio.transmit(command, sizeof(command)));
+  run(&ground, 1000);
+  auto beacons = beacon_starts();
+  CHECK(!beacons.empty());
+  bool sent = false;
+  for (auto& packet : ground_module.transmitted) {
+    if (packet.payload.size() == sizeof(command)) {
+      sent = true;
+      uint64_t epoch = 0;
+      for (auto start : beacons) {
+        if (start <= packet.start_us) {
+          epoch = start;
+        }
+      }
+      CHECK(epoch > 0 && packet.end_us <= epoch + config.time_on_air(TdmaLink<Radio>::frame_length) + ground.slot_length());
+    }
+  }
+  CHECK(sent);
+}
+
+static void slots_follow_node_count() {
+  // two frames per slot, one node without a slot stops sending
+  TdmaGround<> ground(ground_radio, node_count - 1, 2, frame_length);
+  ground.begin();
+  // the node may miss beacons while it still sends in its old slot
+  for (int i = 0; i < 50 && nodes[2].is_synchronised(); ++i) {
+    run(&ground, 100);
+  }
+  CHECK(!nodes[2].is_synchronised());
+  for (auto& module : node_modules) {
+    module.transmitted.clear();
+  }
+  for (auto& count : received) {
+    count = 0;
+  }
+  ground_module.transmitted.clear();
+  run(&ground, 20000);
+  uint32_t periods = beacon_starts().size();
+  CHECK(node_modules[2].transmitted.empty());
+  for (int i = 0; i < node_count - 1; ++i) {
+    CHECK(frames_in_slot(i, ground));
+    CHECK(received[i] + 2 >= 2 * periods);
+  }
+  CHECK(ground_module.collisions == 0);
+}
+
+static void sends_freely_when_disabled() {
+  node_radios[2].disable_tdma();
+  SX1278Emulator::run(config.time_on_air(frame_length) + 1000);
+  CHECK(!node_modules[2].transmitted.empty());
+  for (auto& radio : node_radios) {
+    CHECK(radio.verify_registers());
+  }
+}
+
+int main() {
+  RUN_TEST(nothing_sent_before_beacon);
+  RUN_TEST(flush_before_first_beacon);
+  RUN_TEST(nodes_send_in_their_slots);
+  RUN_TEST(ground_station_sends_in_slot_0);
+  RUN_TEST(slots_follow_node_count);
+  RUN_TEST(sends_freely_when_disabled);
+
+  return host_test_result("tdma_test");
+}
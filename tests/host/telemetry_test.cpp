@@ -0,0 +1,129 @@
+// Round trip of CanSatKitTelemetry.h encoder/decoder.
+// Build & run (from repository root):
+//   g++ -std=gnu++11 -O2 -Isrc tests/host/telemetry_test.cpp -o telemetry_test && ./telemetry_test
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "CanSatKitTelemetry.h"
+#include "host_test.h"
+
+using namespace CanSatKit;
+
+static constexpr TelemetryField schema[] = {
+  TelemetryField::unsigned_int("counter", 16),
+  TelemetryField::fixed("temperature", -40.0, 0.01, 14),
+  TelemetryField::fixed("pressure", 300.0, 0.01, 17),
+  TelemetryField::flag("parachute"),
+  TelemetryField::signed_int("rssi", 8),
+  TelemetryField::varint("uptime"),
+  TelemetryField::zigzag("altitude_change"),
+};
+
+static void round_trip() {
+  const double values[] = {1234, 21.37, 1013.25, 1, -97, 300000, -42};
+  uint8_t frame[32];
+  TelemetryWriter writer(schema, frame, sizeof(frame));
+  for (double value : values) {
+    CHECK(writer.write(value));
+  }
+  // no more fields
+  CHECK(!writer.write(0));
+  // 16 + 14 + 17 + 1 + 8 bits + 3 bytes varint + 1 byte zigzag
+  CHECK(writer.size() == 7 + 3 + 1);
+
+  TelemetryReader reader(schema, frame, writer.size());
+  for (double expected : values) {
+    double value;
+    CHECK(reader.read(value));
+    CHECK(std::fabs(value - expected) < 0.006);
+  }
+  CHECK(std::strcmp(reader.name(), "altitude_change") == 0);
+  double value;
+  CHECK(!reader.read(value));
+  CHECK(reader.ok());
+}
+
+static void saturation() {
+  uint8_t frame[32];
+  TelemetryWriter writer(schema, frame, sizeof(frame));
+  const double values[] = {-5, 1000, NAN, 7, 1000, -1, 1e12};
+  for (double value : values) {
+    writer.write(value);
+  }
+  const double expected[] = {0, -40.0 + 16383 * 0.01, 300, 1, 127, 0, 2147483647};
+  TelemetryReader reader(schema, frame, writer.size());
+  for (double e : expected) {
+    double value;
+    CHECK(reader.read(value));
+    CHECK(std::fabs(value - e) < 1e-6);
+  }
+}
+
+static void varint_sizes() {
+  static constexpr TelemetryField fields[] = {
+    TelemetryField::varint("a"),
+    TelemetryField::zigzag("b"),
+  };
+  struct Case {
+    double varint, zigzag;
+    uint8_t bytes;
+  };
+  const Case cases[] = {{0, 0, 2}, {127, -64, 2}, {128, 64, 4}, {4294967295.0, -2147483648.0, 10}};
+  for (auto& c : cases) {
+    uint8_t frame[10];
+    TelemetryWriter writer(fields, frame, sizeof(frame));
+    CHECK(writer.write(c.varint) && writer.write(c.zigzag));
+    CHECK(writer.size() == c.bytes);
+    TelemetryReader reader(fields, frame, writer.size());
+    double a, b;
+    CHECK(reader.read(a) && reader.read(b));
+    CHECK(a == c.varint && b == c.zigzag);
+  }
+}
+
+static void buffer_too_short() {
+  uint8_t frame[4];
+  TelemetryWriter writer(schema, frame, sizeof(frame));
+  CHECK(writer.write(1) && writer.write(20));
+  // pressure does not fit in the last 2 bits
+  CHECK(!writer.write(1000));
+  CHECK(!writer.ok());
+  CHECK(!writer.write(1));
+
+  // truncated frame
+  uint8_t full[32];
+  TelemetryWriter full_writer(schema, full, sizeof(full));
+  for (int i = 0; i < 7; ++i) {
+    full_writer.write(i);
+  }
+  TelemetryReader reader(schema, full, 4);
+  double value;
+  CHECK(reader.read(value) && reader.read(value));
+  CHECK(!reader.read(value));
+  CHECK(!reader.ok());
+}
+
+static void smaller_than_text() {
+  uint8_t frame[32];
+  TelemetryWriter writer(schema, frame, sizeof(frame));
+  const double values[] = {1234, 21.37, 1013.25, 1, -97, 300000, -42};
+  for (double value : values) {
+    writer.write(value);
+  }
+  char text[128];
+  int length = std::snprintf(text, sizeof(text), "%d;%.2f;%.2f;%d;%d;%d;%d", 1234, 21.37, 1013.25, 1, -97, 300000, -42);
+  std::printf("  binary %u bytes, text %d bytes\n", writer.size(), length);
+  CHECK(writer.size() * 3 <= length);
+}
+
+int main() {
+  RUN_TEST(round_trip);
+  RUN_TEST(saturation);
+  RUN_TEST(varint_sizes);
+  RUN_TEST(buffer_too_short);
+  RUN_TEST(smaller_than_text);
+
+  return host_test_result("telemetry_test");
+}